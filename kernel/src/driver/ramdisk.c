@@ -1,8 +1,9 @@
 #include "common.h"
 #include <string.h>
 
-#define RAMDISK_START ((void *)0)
-#define RAMDISK_SIZE 0xa0000
+/* Keep consistent with nemu/include/memory/memory.h. */
+#define RAMDISK_START ((void *)0xe0000000)
+#define RAMDISK_SIZE (256 * 1024 * 1024)
 
 /* The kernel is monolithic, therefore we do not need to
  * translate the address `buf' from the user process to
@@ -22,6 +22,16 @@ set_bp(void) {
 	asm volatile ("int3");
 }
 
+/* Mark the start of a fuzzing run. NEMU copies at most `size' bytes of
+ * the input into `buf', and returns the length of the input.
+ */
+static __attribute__((always_inline)) inline int
+nemu_fuzz_input(void *buf, int size) {
+	int len;
+	asm volatile(".byte 0xd6" : "=a" (len) : "a" (3), "c" (buf), "d" (size) : "memory");
+	return len;
+}
+
 #else
 
 #define HIT_GOOD_TRAP \
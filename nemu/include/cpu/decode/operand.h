@@ -14,6 +14,7 @@ typedef struct {
 		uint32_t imm;
 		int32_t simm;
 	};
+	uint8_t sreg;	/* segment of a memory operand */
 	uint32_t val;
 	char str[OP_STR_SIZE];
 } Operand;
@@ -2,10 +2,25 @@
 #define __REG_H__
 
 #include "common.h"
+#include "../../../lib-common/x86-inc/cpu.h"
 
 enum { R_EAX, R_ECX, R_EDX, R_EBX, R_ESP, R_EBP, R_ESI, R_EDI };
 enum { R_AX, R_CX, R_DX, R_BX, R_SP, R_BP, R_SI, R_DI };
 enum { R_AL, R_CL, R_DL, R_BL, R_AH, R_CH, R_DH, R_BH };
+enum { R_ES, R_CS, R_SS, R_DS, R_FS, R_GS };
+
+/* The visible part of a segment register is the selector. The hidden
+ * part caches the descriptor, and it is reloaded only when the selector
+ * is written. `flat' is set for segments with base 0 and limit 4GB, so
+ * that the address translation can be skipped entirely.
+ */
+typedef struct {
+	uint16_t selector;
+	uint32_t base;
+	uint32_t limit;
+	uint8_t type;
+	bool flat;
+} SegReg;
 
 /* TODO: Re-organize the `CPU_state' structure to match the register
  * encoding scheme in i386 instruction format. For example, if we
@@ -53,6 +68,20 @@ typedef struct {
 		uint32_t val;
 	} eflags;
 
+	union {
+		SegReg sreg[6];
+		struct {
+			SegReg es, cs, ss, ds, fs, gs;
+		};
+	};
+
+	struct {
+		uint16_t limit;
+		uint32_t base;
+	} gdtr;
+
+	CR0 cr0;
+
 } CPU_state;
 
 extern CPU_state cpu;
@@ -69,5 +98,6 @@ static inline int check_reg_index(int index) {
 extern const char* regsl[];
 extern const char* regsw[];
 extern const char* regsb[];
+extern const char* sregs[];
 
 #endif
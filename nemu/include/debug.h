@@ -6,8 +6,18 @@
 
 extern FILE* log_fp;
 
+/* The log is written to `log_fp' by a background thread. */
+void init_log_writer(int);
+void log_printf(const char *, ...) __attribute__((format(printf, 1, 2)));
+void log_flush();
+
 #ifdef LOG_FILE
-#	define Log_write(format, ...) fprintf(log_fp, format, ## __VA_ARGS__), fflush(log_fp)
+#	define Log_write(format, ...) \
+	do { \
+		if(log_fp) { \
+			log_printf(format, ## __VA_ARGS__); \
+		} \
+	} while(0)
 #else
 #	define Log_write(format, ...)
 #endif
@@ -25,6 +35,7 @@ extern FILE* log_fp;
 	do { \
 		if(!(cond)) { \
 			fflush(stdout); \
+			log_flush(); \
 			fprintf(stderr, "\33[1;31m"); \
 			fprintf(stderr, __VA_ARGS__); \
 			fprintf(stderr, "\33[0m\n"); \
@@ -0,0 +1,51 @@
+#ifndef __DIRTY_H__
+#define __DIRTY_H__
+
+#include "common.h"
+#include "memory/memory.h"
+
+/* One bit for each 4KB page of the physical address space, set when the
+ * page is written by the CPU or by DMA since the last dirty_clear().
+ */
+#define NR_DIRTY_WORD (NR_PMEM_PAGE / 64)
+
+extern uint64_t dirty_bitmap[NR_DIRTY_WORD];
+extern uint32_t nr_dirty_page;
+
+/* A page with its bit set here is handed to cow_fault() before its next
+ * write, which clears the bit. Reverse execution saves the old content of
+ * pages this way. All bits are clear when nobody is interested.
+ */
+extern uint64_t cow_bitmap[NR_DIRTY_WORD];
+void cow_fault(uint32_t);
+
+/* Called before the page is written. */
+static inline void dirty_mark_page(uint32_t page) {
+	uint64_t mask = 1ull << (page & 63);
+	if(cow_bitmap[page >> 6] & mask) {
+		cow_fault(page);
+	}
+	if(!(dirty_bitmap[page >> 6] & mask)) {
+		dirty_bitmap[page >> 6] |= mask;
+		nr_dirty_page ++;
+	}
+}
+
+/* Called on every store, which touches at most two pages. */
+static inline void dirty_mark(hwaddr_t addr, size_t len) {
+	dirty_mark_page(addr >> PMEM_PAGE_SHIFT);
+	dirty_mark_page((addr + len - 1) >> PMEM_PAGE_SHIFT);
+}
+
+void dirty_mark_range(hwaddr_t, size_t);
+void dirty_clear();
+int dirty_next(int);
+
+/* The pages written since the program was loaded, which is what differs
+ * from the files mapped into memory. dirty_clear() keeps them, only
+ * dirty_reset() forgets them, when the program is loaded again.
+ */
+void dirty_reset();
+int changed_next(int);
+
+#endif
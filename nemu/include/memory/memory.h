@@ -3,25 +3,65 @@
 
 #include "common.h"
 
-#define HW_MEM_SIZE (128 * 1024 * 1024)
+/* The size of guest RAM can be changed with the `-m' option. */
+#define HW_MEM_SIZE_DEFAULT (128 * 1024 * 1024)
+#define HW_MEM_SIZE_MAX (4ull * 1024 * 1024 * 1024)
 
 extern uint8_t *hw_mem;
+extern size_t hw_mem_size;
 
 /* convert the hardware address in the test program to virtual address in NEMU */
-#define hwa_to_va(p) ((void *)(hw_mem + (unsigned)p))
+#define hwa_to_va(p) ((void *)(hw_mem + (unsigned)(p)))
 /* convert the virtual address in NEMU to hardware address in the test program */
 #define va_to_hwa(p) ((hwaddr_t)((void *)p - (void *)hw_mem))
 
 #define hw_rw(addr, type) *(type *)({\
-	Assert(addr < HW_MEM_SIZE, "physical address(0x%08x) is out of bound", addr); \
+	Assert(addr < hw_mem_size, "physical address(0x%08x) is out of bound", addr); \
 	hwa_to_va(addr); \
 })
 
-uint32_t swaddr_read(swaddr_t, size_t);
+/* The ramdisk is placed away from low memory, so that it does not
+ * collide with the VGA memory, the entry code or the loaded program.
+ */
+#define RAMDISK_START 0xe0000000
+#define RAMDISK_SIZE (256 * 1024 * 1024)
+
+/* Guest RAM starts at 0, and must end below the ramdisk. */
+#ifdef USE_RAMDISK
+#define HW_MEM_SIZE_LIMIT ((uint64_t)RAMDISK_START)
+#else
+#define HW_MEM_SIZE_LIMIT HW_MEM_SIZE_MAX
+#endif
+
+/* The physical address space is dispatched through a map with one entry
+ * per 4KB page. An entry is either PMEM_RAM, PMEM_UNMAPPED, or the number
+ * of the MMIO map which the page belongs to.
+ */
+#define PMEM_PAGE_SHIFT 12
+#define PMEM_PAGE_SIZE (1 << PMEM_PAGE_SHIFT)
+#define NR_PMEM_PAGE (1 << (32 - PMEM_PAGE_SHIFT))
+
+enum { PMEM_UNMAPPED = -2, PMEM_RAM = -1 };
+
+extern int16_t pmem_map[NR_PMEM_PAGE];
+
+void init_hw_mem(bool);
+void reset_hw_mem();
+void init_pmem_map();
+void pmem_set_map(hwaddr_t, size_t, int);
+void *pmem_host_ptr(hwaddr_t, size_t *);
+
+lnaddr_t swaddr_translate(swaddr_t, size_t, uint8_t);
+uint32_t swaddr_read(swaddr_t, size_t, uint8_t);
+uint32_t swaddr_read_raw(swaddr_t, size_t, uint8_t);
 uint32_t lnaddr_read(lnaddr_t, size_t);
 uint32_t hwaddr_read(hwaddr_t, size_t);
-void swaddr_write(swaddr_t, size_t, uint32_t);
+void swaddr_write(swaddr_t, size_t, uint32_t, uint8_t);
+void swaddr_write_raw(swaddr_t, size_t, uint32_t, uint8_t);
 void lnaddr_write(lnaddr_t, size_t, uint32_t);
 void hwaddr_write(hwaddr_t, size_t, uint32_t);
 
+void init_sreg();
+void load_sreg(uint8_t, uint16_t);
+
 #endif
@@ -0,0 +1,41 @@
+#ifndef __MTRACE_H__
+#define __MTRACE_H__
+
+#include "common.h"
+
+/* The sampled memory access trace. The file starts with a header, and is
+ * followed by records until the end of file.
+ */
+#define MTRACE_MAGIC "NEMUMTR1"
+
+enum { MTRACE_READ, MTRACE_WRITE, MTRACE_FETCH };
+
+typedef struct {
+	char magic[8];
+	uint32_t rate;
+} __attribute__((packed)) MTraceHeader;
+
+typedef struct {
+	uint32_t eip;
+	uint32_t addr;
+	uint8_t len;
+	uint8_t type;
+} __attribute__((packed)) MTraceRecord;
+
+/* Count down to the next access to sample. It never reaches zero
+ * in practice when tracing is off.
+ */
+extern uint32_t mtrace_countdown;
+
+void mtrace_record(swaddr_t, size_t, uint8_t, bool);
+
+static inline void mtrace_sample(swaddr_t addr, size_t len, uint8_t sreg, bool is_write) {
+	if(-- mtrace_countdown == 0) {
+		mtrace_record(addr, len, sreg, is_write);
+	}
+}
+
+bool mtrace_start(const char *, uint32_t);
+void mtrace_stop();
+
+#endif
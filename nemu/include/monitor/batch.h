@@ -0,0 +1,16 @@
+#ifndef __BATCH_H__
+#define __BATCH_H__
+
+#include "common.h"
+
+/* the exit status with --exit-code */
+enum { BATCH_GOOD_TRAP, BATCH_BAD_TRAP, BATCH_NOT_END };
+
+/* `max_instr' and `timeout' (in seconds) are 0 for no limit, `stats_file'
+ * is NULL if no statistics are written.
+ */
+void init_batch(uint64_t max_instr, uint32_t timeout, const char *stats_file, bool exit_code);
+bool batch_enabled();
+void batch_mainloop();
+
+#endif
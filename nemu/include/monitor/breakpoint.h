@@ -0,0 +1,66 @@
+#ifndef __BREAKPOINT_H__
+#define __BREAKPOINT_H__
+
+#include "common.h"
+#include "monitor/expr.h"
+
+typedef struct breakpoint {
+	int NO;
+	struct breakpoint *next;
+	/* the next breakpoint in the same bucket of the hash table */
+	struct breakpoint *hnext;
+
+	swaddr_t addr;
+	bool temporary;
+	bool has_cond;
+	char cond[256];
+	Expr cond_code;
+	uint32_t ignore_count;
+	uint32_t hit_count;
+} BP;
+
+/* The breakpoints are kept in a hash table of the full eip. One bit for
+ * each bucket which is not empty lets most instructions pass with a single
+ * test, and a hit only looks at the breakpoints in its bucket.
+ */
+#define BP_HASH_POW2 16
+#define NR_BP_FILTER_WORD ((1 << BP_HASH_POW2) / 64)
+extern uint64_t bp_filter[NR_BP_FILTER_WORD];
+
+static inline uint32_t bp_hash(swaddr_t eip) {
+	return (eip * 0x9e3779b1u) >> (32 - BP_HASH_POW2);
+}
+
+/* set by check_breakpoints() when a breakpoint stops the execution */
+extern bool bp_hit;
+
+bool check_breakpoints(swaddr_t);
+
+/* Return true if the execution should stop before the instruction at `eip'. */
+static inline bool bp_match(swaddr_t eip) {
+	uint32_t key = bp_hash(eip);
+	if(bp_filter[key >> 6] & (1ull << (key & 63))) {
+		return check_breakpoints(eip);
+	}
+	return false;
+}
+
+bool test_breakpoints(swaddr_t);
+
+/* The same as bp_match(), but the hit is not counted or reported. */
+static inline bool bp_test(swaddr_t eip) {
+	uint32_t key = bp_hash(eip);
+	if(bp_filter[key >> 6] & (1ull << (key & 63))) {
+		return test_breakpoints(eip);
+	}
+	return false;
+}
+
+void init_bp_pool();
+BP* new_bp(swaddr_t addr, bool temporary, const char *cond);
+void free_bp(BP *bp);
+BP* find_bp(int no);
+BP* find_bp_at(swaddr_t addr);
+void print_bp();
+
+#endif
@@ -0,0 +1,67 @@
+#ifndef __CALLGRIND_H__
+#define __CALLGRIND_H__
+
+#include "common.h"
+
+/* the events counted, in the order of the `events:' line */
+enum { CG_IR, CG_DR, CG_DW, CG_BT, NR_CG_EVENT };
+
+/* `key' is the eip of an instruction, or the call site and the callee
+ * of a call edge. `calls' is only used by call edges.
+ */
+typedef struct {
+	uint64_t key;
+	uint64_t cost[NR_CG_EVENT];
+	uint64_t calls;
+} CGEntry;
+
+/* the cost of the instruction being executed, NULL when not profiling */
+extern CGEntry *callgrind_cur;
+extern bool callgrind_on;
+extern uint64_t callgrind_total[NR_CG_EVENT];
+
+void callgrind_begin_record(swaddr_t);
+
+static inline void callgrind_begin(swaddr_t eip) {
+	if(callgrind_on) { callgrind_begin_record(eip); }
+}
+
+/* `taken' is true if the instruction has changed eip. */
+static inline void callgrind_end(bool taken) {
+	CGEntry *e = callgrind_cur;
+	if(e) {
+		e->cost[CG_IR] ++;
+		callgrind_total[CG_IR] ++;
+		if(taken) {
+			e->cost[CG_BT] ++;
+			callgrind_total[CG_BT] ++;
+		}
+		callgrind_cur = NULL;
+	}
+}
+
+static inline void callgrind_mem(bool is_write) {
+	CGEntry *e = callgrind_cur;
+	if(e) {
+		e->cost[is_write ? CG_DW : CG_DR] ++;
+		callgrind_total[is_write ? CG_DW : CG_DR] ++;
+	}
+}
+
+void callgrind_call_record(swaddr_t, swaddr_t, swaddr_t);
+void callgrind_ret_record(swaddr_t);
+
+/* Called by the call and ret instructions before eip is changed. */
+static inline void callgrind_call(swaddr_t callee, swaddr_t site, swaddr_t ret_addr) {
+	if(callgrind_on) { callgrind_call_record(callee, site, ret_addr); }
+}
+
+static inline void callgrind_ret(swaddr_t ret_addr) {
+	if(callgrind_on) { callgrind_ret_record(ret_addr); }
+}
+
+void callgrind_start();
+void callgrind_stop();
+bool callgrind_dump(const char *);
+
+#endif
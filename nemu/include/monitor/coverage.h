@@ -0,0 +1,40 @@
+#ifndef __COVERAGE_H__
+#define __COVERAGE_H__
+
+#include "common.h"
+
+/* The coverage is a bitmap of the addresses where a basic block starts,
+ * that is the entry of the program and every target or fall-through
+ * of a control-transfer instruction. The bitmap is kept in chunks which
+ * are allocated when an address in them is first marked.
+ *
+ * The file written has the header and then the chunks marked, each as its
+ * index (the address shifted right by COVERAGE_CHUNK_POW2) followed by its
+ * bits. The files of different runs are merged by OR-ing the chunks with
+ * the same index, as `nemu-cov' does.
+ */
+#define COVERAGE_MAGIC "NEMUCOV1"
+#define COVERAGE_CHUNK_POW2 16
+#define COVERAGE_CHUNK_BYTES ((1 << COVERAGE_CHUNK_POW2) / 8)
+#define COVERAGE_NR_CHUNK (1 << (32 - COVERAGE_CHUNK_POW2))
+
+typedef struct {
+	char magic[8];
+	uint32_t chunk_pow2;
+	uint32_t nr_chunk;
+} CoverageHeader;
+
+extern bool coverage_on;
+
+void coverage_mark(swaddr_t);
+
+/* Called with the eip after a control-transfer instruction. */
+static inline void coverage_block(swaddr_t eip) {
+	if(coverage_on) { coverage_mark(eip); }
+}
+
+void coverage_start();
+void coverage_stop();
+bool coverage_dump(const char *);
+
+#endif
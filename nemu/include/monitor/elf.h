@@ -1,6 +1,7 @@
 #ifndef __MONITOR_ELF_H__
 #define __MONITOR_ELF_H__
 
+#include "common.h"
 #include <elf.h>
 
 extern char *exec_file;
@@ -8,6 +9,8 @@ extern char *strtab;
 extern Elf32_Sym *symtab;
 extern int nr_symtab_entry;
 
-void load_elf_tables(int argc, char *argv[]);
+void load_elf_tables();
+const Elf32_Sym *find_symbol(swaddr_t, int);
+const Elf32_Sym *find_symbol_by_name(const char *, int);
 
 #endif
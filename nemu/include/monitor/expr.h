@@ -3,6 +3,27 @@
 
 #include "common.h"
 
+#define EXPR_MAX_LEN 32
+
+enum {
+	OP_IMM, OP_EIP, OP_REG32, OP_REG16, OP_REG8,
+	OP_NEG, OP_NOT, OP_DEREF,
+	OP_ADD, OP_SUB, OP_MUL, OP_DIV, OP_EQ, OP_NE, OP_AND, OP_OR
+};
+
+typedef struct {
+	uint8_t op;
+	uint32_t arg;
+} ExprInsn;
+
+/* an expression compiled to postfix code */
+typedef struct {
+	int nr_insn;
+	ExprInsn insn[EXPR_MAX_LEN];
+} Expr;
+
+bool expr_compile(const char *, Expr *);
+uint32_t expr_eval(const Expr *, bool *);
 uint32_t expr(char *, bool *);
 
 #endif
@@ -0,0 +1,39 @@
+#ifndef __FTRACE_H__
+#define __FTRACE_H__
+
+#include "common.h"
+
+enum { FTRACE_CALL, FTRACE_RET };
+
+/* For a call, `func' is the callee and `site' is the address of the call
+ * instruction. For a return, `func' is the function returning and `site'
+ * is the return address. `depth' is the depth of `func' in the call stack.
+ */
+typedef struct {
+	uint32_t type;
+	uint32_t depth;
+	swaddr_t func;
+	swaddr_t site;
+	uint64_t instr;
+} FTraceRecord;
+
+extern bool ftrace_on;
+
+void ftrace_call_record(swaddr_t, swaddr_t, swaddr_t);
+void ftrace_ret_record(swaddr_t);
+
+/* Called by the call and ret instructions before eip is changed. */
+static inline void ftrace_call(swaddr_t callee, swaddr_t site, swaddr_t ret_addr) {
+	if(ftrace_on) { ftrace_call_record(callee, site, ret_addr); }
+}
+
+static inline void ftrace_ret(swaddr_t ret_addr) {
+	if(ftrace_on) { ftrace_ret_record(ret_addr); }
+}
+
+bool ftrace_start(uint32_t, int);
+void ftrace_stop();
+void ftrace_dump(const char *, int);
+void ftrace_stat(const char *);
+
+#endif
@@ -0,0 +1,34 @@
+#ifndef __FUZZ_H__
+#define __FUZZ_H__
+
+#include "common.h"
+#include "monitor/coverage.h"
+
+/* `nemu_trap' with this value in %eax marks the point where the fork
+ * server starts. %ecx and %edx give the buffer and its size for the input,
+ * the length of the input is returned in %eax.
+ */
+#define FUZZ_TRAP 3
+
+#define FUZZ_MAP_SIZE_POW2 16
+#define FUZZ_MAP_SIZE (1 << FUZZ_MAP_SIZE_POW2)
+
+/* the coverage map of the current run, NULL when coverage is not traced */
+extern uint8_t *fuzz_area;
+extern bool fuzz_branch;
+
+/* Called by control-transfer instructions, the edge (and the block for
+ * the coverage) is recorded after the new eip is known.
+ */
+static inline void fuzz_mark_branch() {
+	if(fuzz_area || coverage_on) { fuzz_branch = true; }
+}
+
+void fuzz_edge(swaddr_t);
+
+void init_fuzz(const char *, uint32_t);
+bool fuzz_enabled();
+void fuzz_start();
+void fuzz_mainloop();
+
+#endif
@@ -0,0 +1,11 @@
+#ifndef __GDB_H__
+#define __GDB_H__
+
+#include "common.h"
+
+/* `addr' is a TCP port on localhost, or the path of a Unix socket. */
+void init_gdb(const char *addr);
+bool gdb_enabled();
+void gdb_mainloop();
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef __HASHTRACE_H__
+#define __HASHTRACE_H__
+
+#include "common.h"
+
+/* The hash trace folds the eip of every instruction and the memory writes
+ * into a running hash, and every `interval' instructions appends a record
+ * of the hash with the registers folded in. A record is also written when
+ * the trace stops, so the last one may have a smaller count. The hash is
+ * never reset, so two runs agree on a record only if they agree on all the
+ * records before it, and the first record which differs brackets the
+ * first divergence, as `nemu-diff' uses it.
+ */
+#define HASHTRACE_MAGIC "NEMUHSH1"
+#define HASHTRACE_DEFAULT_INTERVAL (1 << 16)
+
+typedef struct {
+	char magic[8];
+	uint32_t record_size;
+	uint32_t interval;
+} HashTraceHeader;
+
+typedef struct {
+	uint64_t count;
+	uint64_t hash;
+	uint32_t eip;
+	uint32_t pad;
+} HashTraceRecord;
+
+#define HASHTRACE_PRIME 0x100000001b3ull
+
+extern bool hashtrace_on;
+extern uint64_t hashtrace_hash;
+extern uint32_t hashtrace_countdown;
+
+void hashtrace_record();
+
+static inline uint64_t hashtrace_mix(uint64_t h, uint32_t val) {
+	return (h ^ val) * HASHTRACE_PRIME;
+}
+
+/* Called after each instruction with its eip. */
+static inline void hashtrace_tick(swaddr_t eip) {
+	if(hashtrace_on) {
+		hashtrace_hash = hashtrace_mix(hashtrace_hash, eip);
+		if(-- hashtrace_countdown == 0) { hashtrace_record(); }
+	}
+}
+
+static inline void hashtrace_write(swaddr_t addr, size_t len, uint32_t data) {
+	if(hashtrace_on) {
+		hashtrace_hash = hashtrace_mix(hashtrace_mix(hashtrace_mix(hashtrace_hash, addr), len), data);
+	}
+}
+
+bool hashtrace_start(const char *, uint32_t);
+void hashtrace_stop();
+
+#endif
@@ -0,0 +1,62 @@
+#ifndef __ITRACE_H__
+#define __ITRACE_H__
+
+#include "common.h"
+
+/* The instruction trace is a ring of fixed-size records in a file mapped
+ * into memory. `count' in the header is the number of records ever written,
+ * so the oldest record is at `count % nr_record' once the ring is full.
+ */
+#define ITRACE_MAGIC "NEMUITR1"
+#define ITRACE_DEFAULT_LEN (1 << 20)
+
+#define ITRACE_INSTR_LEN 15
+#define ITRACE_NR_MEM 2
+
+typedef struct {
+	char magic[8];
+	uint32_t record_size;
+	uint32_t nr_record;
+	uint64_t count;
+	uint8_t pad[40];
+} ITraceHeader;
+
+/* The registers are the values after the instruction, the changes are
+ * found by comparing with the previous record. `len' is 0 for the
+ * instructions which set eip themselves. Only the first memory writes
+ * are kept, `nr_mem' counts all of them (up to 255).
+ */
+typedef struct {
+	uint32_t eip;
+	uint32_t gpr[8];
+	uint32_t eflags;
+	uint8_t instr[ITRACE_INSTR_LEN];
+	uint8_t len;
+	uint32_t mem_addr[ITRACE_NR_MEM];
+	uint32_t mem_data[ITRACE_NR_MEM];
+	uint8_t mem_len[ITRACE_NR_MEM];
+	uint8_t nr_mem;
+	uint8_t pad;
+} ITraceRecord;
+
+/* the record of the instruction being executed, NULL when tracing is off */
+extern ITraceRecord *itrace_cur;
+
+void itrace_record(swaddr_t, int);
+
+static inline void itrace_write(swaddr_t addr, size_t len, uint32_t data) {
+	ITraceRecord *r = itrace_cur;
+	if(r) {
+		if(r->nr_mem < ITRACE_NR_MEM) {
+			r->mem_addr[r->nr_mem] = addr;
+			r->mem_data[r->nr_mem] = data;
+			r->mem_len[r->nr_mem] = len;
+		}
+		if(r->nr_mem < 255) { r->nr_mem ++; }
+	}
+}
+
+bool itrace_start(const char *, uint32_t);
+void itrace_stop();
+
+#endif
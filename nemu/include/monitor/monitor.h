@@ -1,7 +1,20 @@
 #ifndef __MONITOR_H__
 #define __MONITOR_H__
 
+#include "common.h"
+
 enum { STOP, RUNNING, END };
 extern int nemu_state;
 
+/* the number of instructions executed since NEMU starts, which is moved
+ * back by reverse execution
+ */
+extern uint64_t instr_count;
+
+/* Call `dump' with `file' when NEMU exits, for the results of the
+ * tracers and profilers which cover the whole run.
+ */
+typedef bool (*dump_func_t)(const char *);
+void dump_at_exit(dump_func_t dump, const char *file);
+
 #endif
@@ -0,0 +1,57 @@
+#ifndef __PERF_H__
+#define __PERF_H__
+
+#include "common.h"
+
+/* Counters of the work of NEMU itself. They are always on, and each
+ * costs an increment where it is counted.
+ */
+enum { PERF_READ, PERF_WRITE, PERF_FETCH, NR_PERF_ACCESS };
+
+#define NR_PERF_OPCODE 512	/* one byte opcodes, then two byte ones */
+enum { PERF_PREFIX_OPSIZE, PERF_PREFIX_REP, PERF_PREFIX_REPNZ, NR_PERF_PREFIX };
+#define NR_PERF_DEV 32
+#define NR_PERF_IRQ 16
+
+typedef struct {
+	uint64_t nr_instr;
+	double time;	/* host time spent in cpu_exec() */
+	uint64_t opcode[NR_PERF_OPCODE];	/* the opcode after the prefixes */
+	uint64_t prefix[NR_PERF_PREFIX];
+	uint64_t access[NR_PERF_ACCESS][5];	/* by the size of the access */
+	uint64_t cross_burst;
+	uint64_t irq_raised[NR_PERF_IRQ];
+	uint64_t intr;
+} PerfCounters;
+
+/* the accesses to a map of port I/O or memory-mapped I/O */
+typedef struct {
+	char name[32];
+	uint64_t nr_read, nr_write;
+} PerfDev;
+
+extern PerfCounters perf;
+extern PerfDev perf_dev[NR_PERF_DEV];
+
+static inline void perf_access(int type, size_t len) {
+	perf.access[type][len] ++;
+}
+
+/* Return the index of the counters for the device. The last devices
+ * share the counters when there are too many.
+ */
+int perf_add_dev(const char *);
+
+static inline void perf_dev_access(int dev, bool is_write) {
+	if(is_write) { perf_dev[dev].nr_write ++; }
+	else { perf_dev[dev].nr_read ++; }
+}
+
+void perf_exec_begin();
+void perf_exec_end();
+void perf_pause();
+void perf_resume();
+void perf_reset();
+void perf_print(FILE *);
+
+#endif
@@ -0,0 +1,26 @@
+#ifndef __PROFILE_H__
+#define __PROFILE_H__
+
+#include "common.h"
+
+#define PROFILE_DEFAULT_RATE 1000
+
+/* Count down to the next sample. It never reaches zero in practice when
+ * the profiler is off.
+ */
+extern uint32_t profile_countdown;
+
+void profile_sample();
+
+/* Called after each instruction. */
+static inline void profile_tick() {
+	if(-- profile_countdown == 0) {
+		profile_sample();
+	}
+}
+
+void profile_start(uint32_t);
+void profile_stop();
+bool profile_dump(const char *);
+
+#endif
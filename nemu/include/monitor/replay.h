@@ -0,0 +1,57 @@
+#ifndef __REPLAY_H__
+#define __REPLAY_H__
+
+#include "common.h"
+#include "monitor/monitor.h"
+
+/* The asynchronous events of devices. They are delivered between
+ * instructions and recorded with the instruction count there, so that
+ * replaying them gives the same execution. Events caused by the program
+ * itself, such as the interrupt of IDE, need not be recorded.
+ */
+enum { EVENT_TIMER, EVENT_KEY, NR_EVENT };
+
+#define EVENT_MAGIC "NEMUEVT1"
+
+typedef struct {
+	char magic[8];
+	uint32_t record_size;
+	uint32_t pad;
+} EventHeader;
+
+typedef struct {
+	uint64_t count;
+	uint32_t type;
+	uint32_t data;
+} EventRecord;
+
+enum { REPLAY_OFF, REPLAY_RECORD, REPLAY_PLAY };
+extern int replay_mode;
+
+/* the instruction count of the next event to replay, never reached
+ * when not replaying
+ */
+extern uint64_t replay_next;
+
+typedef void (*event_handler_t)(uint32_t);
+void replay_set_handler(int, event_handler_t);
+
+/* Called by devices between instructions. When replaying, the events
+ * from the host are dropped and those in the file are delivered instead.
+ */
+void replay_event(int, uint32_t);
+
+void replay_deliver();
+
+/* Called by devices between instructions. */
+static inline void replay_poll() {
+	if(instr_count >= replay_next) {
+		replay_deliver();
+	}
+}
+
+bool replay_record_start(const char *);
+bool replay_play_start(const char *);
+void replay_stop();
+
+#endif
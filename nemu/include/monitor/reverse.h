@@ -0,0 +1,33 @@
+#ifndef __REVERSE_H__
+#define __REVERSE_H__
+
+#include "common.h"
+#include "monitor/monitor.h"
+
+#define REVERSE_DEFAULT_INTERVAL (1 << 20)
+#define REVERSE_DEFAULT_BUDGET 64	/* MB */
+
+/* the instruction count of the next checkpoint, never reached when off */
+extern uint64_t reverse_next;
+
+void reverse_checkpoint();
+
+/* Called after every instruction. */
+static inline void reverse_tick() {
+	if(instr_count >= reverse_next) {
+		reverse_checkpoint();
+	}
+}
+
+void reverse_start(uint32_t interval, uint32_t budget);
+void reverse_stop();
+void reverse_info();
+
+/* Called when the machine state is changed by the monitor. */
+void reverse_reset();
+
+/* Return false when the beginning of the history is reached. */
+bool reverse_stepi(uint32_t n);
+bool reverse_continue();
+
+#endif
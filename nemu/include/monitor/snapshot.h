@@ -0,0 +1,26 @@
+#ifndef __SNAPSHOT_H__
+#define __SNAPSHOT_H__
+
+#include "common.h"
+
+typedef void (*snapshot_callback_t)(void);
+
+/* Devices register the memory holding their state, it is saved and
+ * restored byte by byte. `restore' is called after a snapshot is loaded
+ * to bring the host side (files, screen) in line with the state.
+ */
+void add_snapshot_region(const char *, void *, size_t, snapshot_callback_t);
+
+/* Only valid while a snapshot is being saved or loaded. */
+bool snapshot_write(const void *, size_t);
+bool snapshot_read(void *, size_t);
+
+/* All device regions in one buffer, for the checkpoints of reverse execution. */
+size_t snapshot_regions_size();
+void snapshot_regions_save(void *);
+void snapshot_regions_load(const void *);
+
+bool save_snapshot(const char *);
+bool load_snapshot(const char *);
+
+#endif
@@ -2,21 +2,60 @@
 #define __WATCHPOINT_H__
 
 #include "common.h"
+#include "monitor/expr.h"
+
+/* An expression watchpoint is checked after every instruction. The others
+ * watch a range of memory, and are checked when it is accessed.
+ */
+enum { WP_EXPR, WP_WRITE, WP_READ, WP_ACCESS };
 
 typedef struct watchpoint {
 	int NO;
 	struct watchpoint *next;
 
 	/* TODO: Add more members if necessary */
+	int type;
 	char expr[256];
+	Expr code;
 	uint32_t old_value;
 
+	/* the watched range, and the last access to it */
+	swaddr_t addr;
+	uint32_t len;
+	bool hit, hit_write;
+	swaddr_t hit_addr;
 } WP;
 
+/* One bit for each page with watched memory. The range of a watchpoint is
+ * extended by 3 bytes downwards, so that the page of the first byte of an
+ * access touching the range is always marked.
+ */
+#define NR_WP_PAGE_WORD ((1 << 20) / 64)
+extern uint64_t wp_page_bitmap[NR_WP_PAGE_WORD];
+
+/* the last range watchpoint reported by check_watchpoints() */
+extern WP *hit_wp;
+
+void wp_check_access(swaddr_t, size_t, uint8_t, bool);
+
+static inline void wp_access(swaddr_t addr, size_t len, uint8_t sreg, bool is_write) {
+	uint32_t page = addr >> 12;
+	if(wp_page_bitmap[page >> 6] & (1ull << (page & 63))) {
+		wp_check_access(addr, len, sreg, is_write);
+	}
+}
+
 WP* new_wp();
+WP* new_range_wp(int type, swaddr_t addr, uint32_t len);
 void free_wp(WP *wp);
 WP* find_wp(int no);
+WP* find_range_wp(int type, swaddr_t addr, uint32_t len);
 void print_wp();
 bool check_watchpoints();
+bool test_watchpoints();
+void sync_watchpoints();
+bool save_wp();
+bool load_wp(WP **, uint32_t *);
+void restore_wp(WP *, uint32_t);
 
 #endif
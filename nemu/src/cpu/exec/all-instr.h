@@ -45,5 +45,7 @@
 
 #include "misc/misc.h"
 
+#include "system/system.h"
+
 #include "special/special.h"
 
@@ -5,20 +5,26 @@
 make_helper(concat(call_i_, SUFFIX)) {
 	int len = concat(decode_i_, SUFFIX)(cpu.eip + 1);
     reg_l(R_ESP) -= DATA_BYTE;
-    swaddr_write(reg_l(R_ESP), 4, cpu.eip + len + 1);
+    swaddr_write(reg_l(R_ESP), 4, cpu.eip + len + 1, R_SS);
     DATA_TYPE_S imm = op_src -> val;
     print_asm("call\t%x",cpu.eip + 1 + len + imm);
+    ftrace_call(cpu.eip + 1 + len + imm, cpu.eip, cpu.eip + len + 1);
+    callgrind_call(cpu.eip + 1 + len + imm, cpu.eip, cpu.eip + len + 1);
     cpu.eip += imm;
+    fuzz_mark_branch();
     return len + 1;
 } 
 
 make_helper(concat(call_rm_, SUFFIX)){
     int len = concat(decode_rm_, SUFFIX)(cpu.eip + 1);
 	reg_l(R_ESP) -= DATA_BYTE;
-	swaddr_write(reg_l(R_ESP) , 4, cpu.eip + len + 1);
+	swaddr_write(reg_l(R_ESP) , 4, cpu.eip + len + 1, R_SS);
 	DATA_TYPE_S imm = op_src -> val;
 	print_asm("call %x",imm);
+	ftrace_call(imm, cpu.eip, cpu.eip + len + 1);
+	callgrind_call(imm, cpu.eip, cpu.eip + len + 1);
 	cpu.eip = imm - len - 1;
+	fuzz_mark_branch();
 	return len + 1;
 }
 #include "cpu/exec/template-end.h"
\ No newline at end of file
@@ -108,6 +108,9 @@ static void do_execute() {
 		cpu.eip += offset;
 	}
 
+	/* Both the target and the fall-through start a new block. */
+	fuzz_mark_branch();
+
 	print_asm("%s %x", mnemonic, cpu.eip + 1 + DATA_BYTE);
 }
 
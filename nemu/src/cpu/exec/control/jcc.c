@@ -1,4 +1,5 @@
 #include "cpu/exec/helper.h"
+#include "monitor/fuzz.h"
 
 #define DATA_BYTE 1
 #include "jcc-template.h"
@@ -4,6 +4,7 @@
 
 static void do_execute() {
 	cpu.eip += op_src->val;
+	fuzz_mark_branch();
 	print_asm(str(instr) str(SUFFIX) " %s", op_src->str);
 }
 
@@ -12,6 +13,7 @@ make_instr_helper(si)
 make_helper(jmp_rm_l) {
 	int len = decode_rm_l(eip + 1);
 	cpu.eip = op_src->val - (len + 1);
+	fuzz_mark_branch();
 	print_asm(str(instr) str(SUFFIX) " *%s", op_src->str);
 	return len + 1;
 }
@@ -3,18 +3,24 @@
 #define instr ret
 
 make_helper(concat(ret_n_, SUFFIX)) {
-	DATA_TYPE_S ret_addr = swaddr_read(cpu.esp, DATA_BYTE);
+	DATA_TYPE_S ret_addr = swaddr_read(cpu.esp, DATA_BYTE, R_SS);
 	cpu.esp += DATA_BYTE;
+	ftrace_ret(ret_addr);
+	callgrind_ret(ret_addr);
 	cpu.eip = ret_addr;
+	fuzz_mark_branch();
 	print_asm("ret");
 	return 0;
 }
 
 make_helper(concat(ret_i_, SUFFIX)) {
 	uint16_t imm = instr_fetch(eip + 1, 2);
-	DATA_TYPE_S ret_addr = swaddr_read(cpu.esp, DATA_BYTE);
+	DATA_TYPE_S ret_addr = swaddr_read(cpu.esp, DATA_BYTE, R_SS);
 	cpu.esp += DATA_BYTE + imm;
+	ftrace_ret(ret_addr);
+	callgrind_ret(ret_addr);
 	cpu.eip = ret_addr;
+	fuzz_mark_branch();
 	print_asm("ret $0x%x", imm);
 	return 0;
 }
@@ -1,4 +1,7 @@
 #include "cpu/exec/helper.h"
+#include "monitor/fuzz.h"
+#include "monitor/ftrace.h"
+#include "monitor/callgrind.h"
 
 #define DATA_BYTE 1
 #include "ret-template.h"
@@ -7,7 +7,7 @@ make_helper(leave) {
 	cpu.esp = cpu.ebp;
 	
 	// POP EBP (read from stack and increment ESP)
-	cpu.ebp = swaddr_read(cpu.esp, 4);
+	cpu.ebp = swaddr_read(cpu.esp, 4, R_SS);
 	cpu.esp += 4;
 	
 	print_asm("leave");
@@ -4,7 +4,7 @@
 
 static void do_execute() {
 	// Read data from stack top
-	DATA_TYPE data = swaddr_read(cpu.esp, DATA_BYTE);
+	DATA_TYPE data = swaddr_read(cpu.esp, DATA_BYTE, R_SS);
 	
 	// Store to destination
 	OPERAND_W(op_src, data);
@@ -5,12 +5,12 @@
 static void do_execute() {
 	if (DATA_BYTE == 2) {
 		reg_l(R_ESP) -= 2;
-		swaddr_write(reg_l(R_ESP), 2, (DATA_TYPE)op_src->val);
+		swaddr_write(reg_l(R_ESP), 2, (DATA_TYPE)op_src->val, R_SS);
 	} else {
 		if (DATA_BYTE == 1)
 			op_src->val = (int8_t)op_src->val;
 		reg_l(R_ESP) -= 4;
-		swaddr_write(reg_l(R_ESP), 4, op_src->val);
+		swaddr_write(reg_l(R_ESP), 4, op_src->val, R_SS);
 	}
 
 	print_asm_template1();
@@ -1,8 +1,10 @@
 #include "cpu/exec/helper.h"
+#include "monitor/perf.h"
 
 make_helper(exec);
 
 make_helper(operand_size) {
+	perf.prefix[PERF_PREFIX_OPSIZE] ++;
 	ops_decoded.is_operand_size_16 = true;
 	int instr_len = exec(eip + 1);
 	ops_decoded.is_operand_size_16 = false;
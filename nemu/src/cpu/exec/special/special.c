@@ -1,5 +1,6 @@
 #include "cpu/exec/helper.h"
 #include "monitor/monitor.h"
+#include "monitor/fuzz.h"
 
 make_helper(inv) {
 	/* invalid opcode */
@@ -31,6 +32,10 @@ make_helper(nemu_trap) {
 		case 2:
 		   	break;
 
+		case FUZZ_TRAP:
+			fuzz_start();
+			break;
+
 		default:
 			printf("\33[1;31mnemu: HIT %s TRAP\33[0m at eip = 0x%08x\n\n",
 					(cpu.eax == 0 ? "GOOD" : "BAD"), cpu.eip);
@@ -4,7 +4,7 @@
 
 make_helper(concat(lods_, SUFFIX)) {
 	// Load from [ESI] to accumulator (AL/AX/EAX)
-	REG(R_EAX) = MEM_R(cpu.esi);
+	REG(R_EAX) = MEM_R(cpu.esi, R_DS);
 	
 	// Adjust ESI based on DF flag
 	cpu.esi += (cpu.eflags.DF ? -DATA_BYTE : DATA_BYTE);
@@ -1,11 +1,14 @@
 #include "cpu/exec/helper.h"
+#include "monitor/perf.h"
 
 make_helper(exec);
 
 make_helper(rep) {
 	int len;
 	int count = 0;
-	if(instr_fetch(eip + 1, 1) == 0xc3) {
+	uint8_t opcode = instr_fetch(eip + 1, 1);
+	perf.prefix[PERF_PREFIX_REP] ++;
+	if(opcode == 0xc3) {
 		/* repz ret */
 		exec(eip + 1);
 		len = 0;
@@ -32,6 +35,8 @@ make_helper(rep) {
 			break;
 		}		}
 		len = 1;
+		/* The string instruction is not decoded when nothing is repeated. */
+		if(count == 0) { ops_decoded.opcode = opcode; }
 	}
 
 #ifdef DEBUG
@@ -45,6 +50,7 @@ make_helper(rep) {
 
 make_helper(repnz) {
 	int count = 0;
+	perf.prefix[PERF_PREFIX_REPNZ] ++;
 	while(cpu.ecx) {
 		exec(eip + 1);
 		count ++;
@@ -60,6 +66,8 @@ make_helper(repnz) {
 		}
 
 	}
+	/* The string instruction is not decoded when nothing is repeated. */
+	if(count == 0) { ops_decoded.opcode = instr_fetch(eip + 1, 1); }
 
 #ifdef DEBUG
 	char temp[80];
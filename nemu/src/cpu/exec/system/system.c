@@ -0,0 +1,70 @@
+#include "cpu/exec/helper.h"
+#include "cpu/decode/modrm.h"
+#include "monitor/fuzz.h"
+
+make_helper(lgdt) {
+	int len = decode_rm_l(eip + 1);
+	assert(op_src->type == OP_TYPE_MEM);
+	cpu.gdtr.limit = swaddr_read(op_src->addr, 2, op_src->sreg);
+	cpu.gdtr.base = swaddr_read(op_src->addr + 2, 4, op_src->sreg);
+
+	print_asm("lgdt %s", op_src->str);
+	return len + 1;
+}
+
+make_helper(mov_cr2r) {
+	ModR_M m;
+	m.val = instr_fetch(eip + 1, 1);
+	switch(m.reg) {
+		case 0: reg_l(m.R_M) = cpu.cr0.val; break;
+		default: panic("mov from cr%d is not implemented", m.reg);
+	}
+
+	print_asm("movl %%cr%d,%%%s", m.reg, regsl[m.R_M]);
+	return 2;
+}
+
+make_helper(mov_r2cr) {
+	ModR_M m;
+	m.val = instr_fetch(eip + 1, 1);
+	switch(m.reg) {
+		case 0: cpu.cr0.val = reg_l(m.R_M); break;
+		default: panic("mov to cr%d is not implemented", m.reg);
+	}
+
+	print_asm("movl %%%s,%%cr%d", regsl[m.R_M], m.reg);
+	return 2;
+}
+
+make_helper(mov_rm2sreg) {
+	ModR_M m;
+	m.val = instr_fetch(eip + 1, 1);
+	assert(m.reg <= R_GS && m.reg != R_CS);
+	int len = decode_rm_w(eip + 1);
+	load_sreg(m.reg, op_src->val);
+
+	print_asm("movw %s,%%%s", op_src->str, sregs[m.reg]);
+	return len + 1;
+}
+
+make_helper(mov_sreg2rm) {
+	ModR_M m;
+	m.val = instr_fetch(eip + 1, 1);
+	assert(m.reg <= R_GS);
+	int len = decode_rm_w(eip + 1);
+	write_operand_w(op_src, cpu.sreg[m.reg].selector);
+
+	print_asm("movw %%%s,%s", sregs[m.reg], op_src->str);
+	return len + 1;
+}
+
+make_helper(ljmp) {
+	swaddr_t addr = instr_fetch(eip + 1, 4);
+	uint16_t selector = instr_fetch(eip + 5, 2);
+	load_sreg(R_CS, selector);
+	cpu.eip = addr;
+	fuzz_mark_branch();
+
+	print_asm("ljmp $0x%x,$0x%x", selector, addr);
+	return 0;
+}
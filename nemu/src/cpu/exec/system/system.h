@@ -0,0 +1,11 @@
+#ifndef __SYSTEM_H__
+#define __SYSTEM_H__
+
+make_helper(lgdt);
+make_helper(mov_cr2r);
+make_helper(mov_r2cr);
+make_helper(mov_rm2sreg);
+make_helper(mov_sreg2rm);
+make_helper(ljmp);
+
+#endif
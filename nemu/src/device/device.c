@@ -6,6 +6,7 @@ void init_timer();
 void init_vga();
 void init_i8042();
 void init_ide();
+void init_i8259();
 
 void init_device() {
 	init_serial();
@@ -13,6 +14,7 @@ void init_device() {
 	init_vga();
 	init_i8042();
 	init_ide();
+	init_i8259();
 }
 
 #endif
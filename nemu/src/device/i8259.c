@@ -1,5 +1,7 @@
 #include "common.h"
 #include "cpu/reg.h"
+#include "monitor/snapshot.h"
+#include "monitor/perf.h"
 
 #define IRQ_BASE 32
 #define NO_INTR -1
@@ -62,6 +64,7 @@ static void do_i8259() {
 /* device interface */
 void i8259_raise_intr(int n) {
 	assert(n >= 0 && n < 16);
+	perf.irq_raised[n] ++;
 	if(n < 8) {
 		master.IRR |= MASK(n);
 	}
@@ -87,6 +90,7 @@ void i8259_ack_intr() {
 	if(intr_NO == NO_INTR) {
 		return;
 	}
+	perf.intr ++;
 
 	int n = intr_NO - IRQ_BASE;
 	if(n < 8) {
@@ -104,3 +108,9 @@ void i8259_ack_intr() {
 
 	do_i8259();
 }
+
+void init_i8259() {
+	add_snapshot_region("i8259 master", &master, sizeof(master), NULL);
+	add_snapshot_region("i8259 slave", &slave, sizeof(slave), NULL);
+	add_snapshot_region("i8259 intr_NO", &intr_NO, sizeof(intr_NO), NULL);
+}
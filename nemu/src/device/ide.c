@@ -1,7 +1,9 @@
 #include "common.h"
 #include "memory/memory.h"
+#include "memory/dirty.h"
 #include "device/port-io.h"
 #include "device/i8259.h"
+#include "monitor/snapshot.h"
 
 #define IDE_CTRL_PORT 0x3F6
 #define IDE_PORT 0x1F0
@@ -103,6 +105,7 @@ void bmr_io_handler(ioaddr_t addr, size_t len, bool is_write) {
 					disk_idx = sector << 9;
 					fseek(disk_fp, disk_idx, SEEK_SET);
 
+					dirty_mark_range(addr, byte_cnt);
 					ret = fread((void *)hwa_to_va(addr), byte_cnt, 1, disk_fp);
 					assert(ret == 1 || feof(disk_fp));
 
@@ -122,6 +125,11 @@ void bmr_io_handler(ioaddr_t addr, size_t len, bool is_write) {
 	}
 }
 
+/* Move the disk file to where the restored transfer continues. */
+static void ide_restore() {
+	fseek(disk_fp, disk_idx + byte_cnt, SEEK_SET);
+}
+
 void init_ide() {
 	ide_port_base = add_pio_map(IDE_PORT, 8, ide_io_handler);
 	ide_port_base[7] = 0x40;
@@ -132,4 +140,9 @@ void init_ide() {
 	extern char *exec_file;
 	disk_fp = fopen(exec_file, "r+");
 	Assert(disk_fp, "Can not open '%s'", exec_file);
+
+	add_snapshot_region("ide sector", &sector, sizeof(sector), NULL);
+	add_snapshot_region("ide byte_cnt", &byte_cnt, sizeof(byte_cnt), NULL);
+	add_snapshot_region("ide write", &ide_write, sizeof(ide_write), NULL);
+	add_snapshot_region("ide position", &disk_idx, sizeof(disk_idx), ide_restore);
 }
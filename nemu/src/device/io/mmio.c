@@ -1,18 +1,20 @@
 #include "common.h"
+#include "memory/memory.h"
 #include "device/mmio.h"
+#include "monitor/snapshot.h"
+#include "monitor/perf.h"
 #include "misc.h"
 
-#define MMIO_SPACE_MAX (256 * 1024)
-#define NR_MAP 8
+#include <stdlib.h>
 
-static uint8_t mmio_space_pool[MMIO_SPACE_MAX];
-static uint32_t mmio_space_free_index = 0;
+#define NR_MAP 1024
 
 typedef struct {
 	hwaddr_t low;
 	hwaddr_t high;
 	uint8_t *mmio_space;
 	mmio_callback_t callback;
+	int perf;
 } MMIO_t;
 
 static MMIO_t maps[NR_MAP];
@@ -21,34 +23,44 @@ static int nr_map = 0;
 /* device interface */
 void* add_mmio_map(hwaddr_t addr, size_t len, mmio_callback_t callback) {
 	assert(nr_map < NR_MAP);
-	assert(mmio_space_free_index + len <= MMIO_SPACE_MAX);
+	/* The physical memory map routes whole pages, a partial page would take
+	 * the RAM after the region with it. */
+	Assert(((addr | len) & (PMEM_PAGE_SIZE - 1)) == 0,
+			"MMIO region 0x%08x of %zu bytes is not page aligned", addr, len);
+
+	/* "+ 3" is for hacking, see mmio_read() below */
+	uint8_t *space_base = calloc(len + 3, 1);
+	assert(space_base);
 
-	uint8_t *space_base = &mmio_space_pool[mmio_space_free_index];
 	maps[nr_map].low = addr;
 	maps[nr_map].high = addr + len - 1;
 	maps[nr_map].mmio_space = space_base;
 	maps[nr_map].callback = callback;
+
+	/* Route the pages of this region to the map in the physical memory map. */
+	pmem_set_map(addr, len, nr_map);
 	nr_map ++;
-	mmio_space_free_index += len;
+
+	char name[32];
+	snprintf(name, sizeof(name), "mmio 0x%08x", addr);
+	add_snapshot_region(name, space_base, len, NULL);
+	maps[nr_map - 1].perf = perf_add_dev(name);
 	return space_base;
 }
 
 /* bus interface */
 int is_mmio(hwaddr_t addr) {
-	int i;
-	for(i = 0; i < nr_map; i ++) {
-		if(addr >= maps[i].low && addr <= maps[i].high) {
-			return i;
-		}
-	}
-	return -1;
+	int map_NO = pmem_map[addr >> PMEM_PAGE_SHIFT];
+	return (map_NO >= 0 ? map_NO : -1);
 }
 
 uint32_t mmio_read(hwaddr_t addr, size_t len, int map_NO) {
 	assert(len == 1 || len == 2 || len == 4);
 	MMIO_t *map = &maps[map_NO];
+	Assert(addr + len - 1 <= map->high, "MMIO access 0x%08x is outside of the map", addr);
 	uint32_t data = *(uint32_t *)(map->mmio_space + (addr - map->low)) 
 		& (~0u >> ((4 - len) << 3));
+	perf_dev_access(map->perf, false);
 	map->callback(addr, len, false);
 	return data;
 }
@@ -56,7 +68,9 @@ uint32_t mmio_read(hwaddr_t addr, size_t len, int map_NO) {
 void mmio_write(hwaddr_t addr, size_t len, uint32_t data, int map_NO) {
 	assert(len == 1 || len == 2 || len == 4);
 	MMIO_t *map = &maps[map_NO];
+	Assert(addr + len - 1 <= map->high, "MMIO access 0x%08x is outside of the map", addr);
 	uint32_t mask = (~0u >> ((4 - len) << 3));
 	memcpy_with_mask(map->mmio_space + (addr - map->low), &data, len, (void *)&mask);
+	perf_dev_access(map->perf, true);
 	maps[map_NO].callback(addr, len, true);
 }
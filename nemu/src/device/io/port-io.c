@@ -1,5 +1,7 @@
 #include "common.h"
 #include "device/port-io.h"
+#include "monitor/snapshot.h"
+#include "monitor/perf.h"
 
 #define PORT_IO_SPACE_MAX 65536
 #define NR_MAP 8
@@ -11,6 +13,7 @@ typedef struct {
 	ioaddr_t low;
 	ioaddr_t high;
 	pio_callback_t callback;
+	int perf;
 } PIO_t;
 
 static PIO_t maps[NR_MAP];
@@ -20,6 +23,7 @@ static void pio_callback(ioaddr_t addr, size_t len, bool is_write) {
 	int i;
 	for(i = 0; i < nr_map; i ++) {
 		if(addr >= maps[i].low && addr + len - 1 <= maps[i].high) {
+			perf_dev_access(maps[i].perf, is_write);
 			maps[i].callback(addr, len, is_write);
 			return;
 		}
@@ -34,6 +38,11 @@ void* add_pio_map(ioaddr_t addr, size_t len, pio_callback_t callback) {
 	maps[nr_map].high = addr + len - 1;
 	maps[nr_map].callback = callback;
 	nr_map ++;
+
+	char name[32];
+	snprintf(name, sizeof(name), "pio 0x%04x", addr);
+	add_snapshot_region(name, pio_space + addr, len, NULL);
+	maps[nr_map - 1].perf = perf_add_dev(name);
 	return pio_space + addr;
 }
 
@@ -4,6 +4,7 @@
 
 #include "sdl.h"
 #include "vga.h"
+#include "monitor/replay.h"
 
 #include <sys/time.h>
 #include <signal.h>
@@ -18,29 +19,48 @@ static uint64_t jiffy = 0;
 static struct itimerval it;
 static int device_update_flag = false;
 static int update_screen_flag = false;
+static int timer_flag = false;
 extern void timer_intr();
-extern void keyboard_intr();
+extern void keyboard_intr(uint8_t);
 extern void update_screen();
 
+/* The tick is only delivered between instructions, by device_update(). */
 static void timer_sig_handler(int signum) {
+	timer_flag = true;
+	device_update_flag = true;
+
+	int ret = setitimer(ITIMER_VIRTUAL, &it, NULL);
+	Assert(ret == 0, "Can not set timer");
+}
+
+static void timer_event(uint32_t data) {
 	jiffy ++;
 	timer_intr();
 
-	device_update_flag = true;
 	if(jiffy % (TIMER_HZ / VGA_HZ) == 0) {
 		update_screen_flag = true;
+		device_update_flag = true;
 	}
+}
 
-	int ret = setitimer(ITIMER_VIRTUAL, &it, NULL);
-	Assert(ret == 0, "Can not set timer");
+static void key_event(uint32_t scancode) {
+	keyboard_intr(scancode);
 }
 
 void device_update() {
+	/* When replaying, the events come from the record instead. */
+	replay_poll();
+
 	if(!device_update_flag) {
 		return;
 	}
 	device_update_flag = false;
 
+	if(timer_flag) {
+		timer_flag = false;
+		replay_event(EVENT_TIMER, 0);
+	}
+
 	if(update_screen_flag) {
 		update_screen();
 		update_screen_flag = false;
@@ -52,10 +72,10 @@ void device_update() {
 
 		uint32_t sym = event.key.keysym.sym;
 		if( event.type == SDL_KEYDOWN ) {
-			keyboard_intr(sym2scancode[sym >> 8][sym & 0xff]);
+			replay_event(EVENT_KEY, sym2scancode[sym >> 8][sym & 0xff]);
 		}
 		else if( event.type == SDL_KEYUP ) {
-			keyboard_intr(sym2scancode[sym >> 8][sym & 0xff] | 0x80);
+			replay_event(EVENT_KEY, sym2scancode[sym >> 8][sym & 0xff] | 0x80);
 		}
 
 		// If the user has Xed out the window
@@ -90,6 +110,13 @@ void init_sdl() {
 
 	SDL_EnableKeyRepeat(SDL_DEFAULT_REPEAT_DELAY, SDL_DEFAULT_REPEAT_INTERVAL);
 
+	replay_set_handler(EVENT_TIMER, timer_event);
+	replay_set_handler(EVENT_KEY, key_event);
+	if(replay_mode == REPLAY_PLAY) {
+		/* The ticks come from the record, not from the host. */
+		return;
+	}
+
 	struct sigaction s;
 	memset(&s, 0, sizeof(s));
 	s.sa_handler = timer_sig_handler;
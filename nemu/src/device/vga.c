@@ -6,6 +6,7 @@
 #include "device/port-io.h"
 #include "device/mmio.h"
 #include "device/i8259.h"
+#include "monitor/snapshot.h"
 
 enum {Horizontal_Total_Register, End_Horizontal_Display_Register, 
 	Start_Horizontal_Blanking_Register, End_Horizontal_Blanking_Register,
@@ -105,9 +106,19 @@ void vga_crtc_io_handler(ioaddr_t addr, size_t len, bool is_write) {
 	}
 }
 
+/* Load the restored palette and redraw the whole screen. */
+static void vga_restore() {
+	SDL_SetPalette(real_screen, SDL_LOGPAL | SDL_PHYSPAL, (void *)&palette, 0, 256);
+	SDL_SetPalette(screen, SDL_LOGPAL, (void *)&palette, 0, 256);
+	memset(line_dirty, true, CTR_ROW);
+	vmem_dirty = true;
+}
+
 void init_vga() {
 	vga_dac_port_base = add_pio_map(VGA_DAC_WRITE_INDEX, 2, vga_dac_io_handler);
 	vga_crtc_port_base = add_pio_map(VGA_CRTC_INDEX, 2, vga_crtc_io_handler);
 	vmem_base = add_mmio_map(0xa0000, 0x20000, vga_vmem_io_handler);
+	add_snapshot_region("vga crtc", vga_crtc_regs, sizeof(vga_crtc_regs), NULL);
+	add_snapshot_region("vga palette", palette, 256 * sizeof(Color), vga_restore);
 }
 #endif	/* HAS_DEVICE */
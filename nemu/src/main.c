@@ -1,3 +1,7 @@
+#include "monitor/fuzz.h"
+#include "monitor/gdb.h"
+#include "monitor/batch.h"
+
 void init_monitor(int, char *[]);
 void reg_test();
 void restart();
@@ -14,6 +18,21 @@ int main(int argc, char *argv[]) {
 	/* Initialize the virtual computer system. */
 	restart();
 
+	if(fuzz_enabled()) {
+		/* Run the program as the target of a fuzzer. */
+		fuzz_mainloop();
+	}
+
+	if(batch_enabled()) {
+		/* Run the program without the user interface. */
+		batch_mainloop();
+	}
+
+	if(gdb_enabled()) {
+		/* Let gdb control the program until it detaches. */
+		gdb_mainloop();
+	}
+
 	/* Receive commands from user. */
 	ui_mainloop();
 
@@ -0,0 +1,63 @@
+#include "memory/dirty.h"
+
+uint64_t dirty_bitmap[NR_DIRTY_WORD];
+uint32_t nr_dirty_page = 0;
+uint64_t cow_bitmap[NR_DIRTY_WORD];
+
+/* the pages dirty before the last dirty_clear() since dirty_reset() */
+static uint64_t changed_bitmap[NR_DIRTY_WORD];
+
+/* used by devices which write guest memory directly, such as DMA, before
+ * the memory is written
+ */
+void dirty_mark_range(hwaddr_t addr, size_t len) {
+	if(len == 0) { return; }
+
+	uint32_t page = addr >> PMEM_PAGE_SHIFT;
+	uint32_t last = (uint32_t)(addr + len - 1) >> PMEM_PAGE_SHIFT;
+	for(; page <= last; page ++) {
+		dirty_mark_page(page);
+	}
+}
+
+void dirty_clear() {
+	int i;
+	for(i = 0; i < NR_DIRTY_WORD; i ++) {
+		changed_bitmap[i] |= dirty_bitmap[i];
+	}
+	memset(dirty_bitmap, 0, sizeof(dirty_bitmap));
+	nr_dirty_page = 0;
+}
+
+void dirty_reset() {
+	memset(changed_bitmap, 0, sizeof(changed_bitmap));
+	memset(dirty_bitmap, 0, sizeof(dirty_bitmap));
+	nr_dirty_page = 0;
+}
+
+/* the first page not less than `page' set in `a' or in `b' */
+static int next_page(const uint64_t *a, const uint64_t *b, int page) {
+	if(page < 0 || page >= NR_PMEM_PAGE) { return -1; }
+
+	int idx = page >> 6;
+	uint64_t word = (a[idx] | (b ? b[idx] : 0)) & (~0ull << (page & 63));
+	while(word == 0) {
+		if(++ idx == NR_DIRTY_WORD) { return -1; }
+		word = a[idx] | (b ? b[idx] : 0);
+	}
+
+	return (idx << 6) + __builtin_ctzll(word);
+}
+
+/* Return the number of the first dirty page not less than `page',
+ * or -1 if there is none. Iterate over all dirty pages with
+ *   for(p = dirty_next(0); p >= 0; p = dirty_next(p + 1)) { ... }
+ */
+int dirty_next(int page) {
+	return next_page(dirty_bitmap, NULL, page);
+}
+
+/* The same as dirty_next(), over the pages written since dirty_reset(). */
+int changed_next(int page) {
+	return next_page(changed_bitmap, dirty_bitmap, page);
+}
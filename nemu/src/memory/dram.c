@@ -1,6 +1,10 @@
 #include "common.h"
 #include "burst.h"
 #include "misc.h"
+#include "memory/memory.h"
+#include "monitor/perf.h"
+
+#include <sys/mman.h>
 
 /* Simulate the (main) behavor of DRAM.
  * Although this will lower the performace of NEMU, it makes
@@ -11,7 +15,7 @@
 #define COL_WIDTH 10
 #define ROW_WIDTH 10
 #define BANK_WIDTH 3
-#define RANK_WIDTH (27 - COL_WIDTH - ROW_WIDTH - BANK_WIDTH)
+#define RANK_WIDTH (32 - COL_WIDTH - ROW_WIDTH - BANK_WIDTH)
 
 typedef union {
 	struct {
@@ -29,10 +33,12 @@ typedef union {
 #define NR_BANK (1 << BANK_WIDTH)
 #define NR_RANK (1 << RANK_WIDTH)
 
-#define HW_MEM_SIZE (1 << (COL_WIDTH + ROW_WIDTH + BANK_WIDTH + RANK_WIDTH))
+/* The storage of a row is located by the address with the column bits cleared. */
+#define dram_row(rank, bank, row) \
+	(hw_mem + ((((((rank) << BANK_WIDTH) | (bank)) << ROW_WIDTH) | (row)) << COL_WIDTH))
 
-uint8_t dram[NR_RANK][NR_BANK][NR_ROW][NR_COL];
-uint8_t *hw_mem = (void *)dram;
+uint8_t *hw_mem = NULL;
+size_t hw_mem_size = HW_MEM_SIZE_DEFAULT;
 
 typedef struct {
 	uint8_t buf[NR_COL];
@@ -42,6 +48,71 @@ typedef struct {
 
 RB rowbufs[NR_RANK][NR_BANK];
 
+static bool use_hugetlb = false;
+static bool use_thp = false;
+
+/* Huge pages are only used by a mapping aligned to their size. */
+#define HUGE_PAGE_SIZE (2 * 1024 * 1024)
+#define HUGE_PAGE_ROUND_UP(x) (((x) + HUGE_PAGE_SIZE - 1) & ~(size_t)(HUGE_PAGE_SIZE - 1))
+
+/* Map fresh zero pages over the whole physical address space, replacing
+ * any file mapped into it. Pages are only committed when the guest
+ * touches them, except hugetlb pages of guest RAM, which are reserved up
+ * front, otherwise a short pool results in SIGBUS later.
+ */
+static void map_hw_mem() {
+	int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED;
+	void *p = mmap(hw_mem, HW_MEM_SIZE_MAX, PROT_READ | PROT_WRITE, flags | MAP_NORESERVE, -1, 0);
+	Assert(p != MAP_FAILED, "can not map the physical address space");
+
+#ifdef MAP_HUGETLB
+	if(use_hugetlb) {
+		/* The tail after guest RAM is not in the physical memory map. */
+		p = mmap(hw_mem, HUGE_PAGE_ROUND_UP(hw_mem_size), PROT_READ | PROT_WRITE, flags | MAP_HUGETLB, -1, 0);
+		if(p != MAP_FAILED) {
+			return;
+		}
+
+		Log("can not map guest RAM with hugetlb pages, fall back to transparent huge pages");
+		use_hugetlb = false;
+		p = mmap(hw_mem, hw_mem_size, PROT_READ | PROT_WRITE, flags | MAP_NORESERVE, -1, 0);
+		Assert(p != MAP_FAILED, "can not map guest RAM");
+	}
+#endif
+#ifdef MADV_HUGEPAGE
+	if(use_thp) {
+		madvise(hw_mem, hw_mem_size, MADV_HUGEPAGE);
+	}
+#endif
+}
+
+/* The whole 4GB physical address space is reserved with mmap() but not
+ * committed. The physical memory map decides which parts of it are valid,
+ * and files can be mapped into it copy-on-write. The reservation starts
+ * at a huge page boundary, the extra space around it is given back.
+ */
+void init_hw_mem(bool huge_page) {
+	size_t size = HW_MEM_SIZE_MAX + HUGE_PAGE_SIZE;
+	uint8_t *p = mmap(NULL, size, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	Assert(p != MAP_FAILED, "can not reserve the physical address space");
+	hw_mem = (uint8_t *)HUGE_PAGE_ROUND_UP((uintptr_t)p);
+	if(hw_mem > p) {
+		munmap(p, hw_mem - p);
+	}
+	munmap(hw_mem + HW_MEM_SIZE_MAX, p + size - (hw_mem + HW_MEM_SIZE_MAX));
+
+	use_hugetlb = use_thp = huge_page;
+	map_hw_mem();
+}
+
+/* Discard all pages of the physical address space, including the files
+ * mapped into it, so that it reads as zero afterwards. Nothing is written
+ * to memory to achieve this.
+ */
+void reset_hw_mem() {
+	map_hw_mem();
+}
+
 void init_ddr3() {
 	int i, j;
 	for(i = 0; i < NR_RANK; i ++) {
@@ -52,8 +123,7 @@ void init_ddr3() {
 }
 
 static void ddr3_read(hwaddr_t addr, void *data) {
-	Assert(addr < HW_MEM_SIZE, "physical address %x is outside of the physical memory!", addr);
-
+	/* The physical memory map has checked that `addr' is backed by memory. */
 	dram_addr temp;
 	temp.addr = addr & ~BURST_MASK;
 	uint32_t rank = temp.rank;
@@ -63,7 +133,7 @@ static void ddr3_read(hwaddr_t addr, void *data) {
 
 	if(!(rowbufs[rank][bank].valid && rowbufs[rank][bank].row_idx == row) ) {
 		/* read a row into row buffer */
-		memcpy(rowbufs[rank][bank].buf, dram[rank][bank][row], NR_COL);
+		memcpy(rowbufs[rank][bank].buf, dram_row(rank, bank, row), NR_COL);
 		rowbufs[rank][bank].row_idx = row;
 		rowbufs[rank][bank].valid = true;
 	}
@@ -73,8 +143,7 @@ static void ddr3_read(hwaddr_t addr, void *data) {
 }
 
 static void ddr3_write(hwaddr_t addr, void *data, uint8_t *mask) {
-	Assert(addr < HW_MEM_SIZE, "physical address %x is outside of the physical memory!", addr);
-
+	/* The physical memory map has checked that `addr' is backed by memory. */
 	dram_addr temp;
 	temp.addr = addr & ~BURST_MASK;
 	uint32_t rank = temp.rank;
@@ -84,7 +153,7 @@ static void ddr3_write(hwaddr_t addr, void *data, uint8_t *mask) {
 
 	if(!(rowbufs[rank][bank].valid && rowbufs[rank][bank].row_idx == row) ) {
 		/* read a row into row buffer */
-		memcpy(rowbufs[rank][bank].buf, dram[rank][bank][row], NR_COL);
+		memcpy(rowbufs[rank][bank].buf, dram_row(rank, bank, row), NR_COL);
 		rowbufs[rank][bank].row_idx = row;
 		rowbufs[rank][bank].valid = true;
 	}
@@ -93,7 +162,7 @@ static void ddr3_write(hwaddr_t addr, void *data, uint8_t *mask) {
 	memcpy_with_mask(rowbufs[rank][bank].buf + col, data, BURST_LEN, mask);
 
 	/* write back to dram */
-	memcpy(dram[rank][bank][row], rowbufs[rank][bank].buf, NR_COL);
+	memcpy(dram_row(rank, bank, row), rowbufs[rank][bank].buf, NR_COL);
 }
 
 uint32_t dram_read(hwaddr_t addr, size_t len) {
@@ -104,6 +173,7 @@ uint32_t dram_read(hwaddr_t addr, size_t len) {
 
 	if(offset + len > BURST_LEN) {
 		/* data cross the burst boundary */
+		perf.cross_burst ++;
 		ddr3_read(addr + BURST_LEN, temp + BURST_LEN);
 	}
 
@@ -123,6 +193,7 @@ void dram_write(hwaddr_t addr, size_t len, uint32_t data) {
 
 	if(offset + len > BURST_LEN) {
 		/* data cross the burst boundary */
+		perf.cross_burst ++;
 		ddr3_write(addr + BURST_LEN, temp + BURST_LEN, mask + BURST_LEN);
 	}
 }
@@ -1,16 +1,88 @@
 #include "common.h"
+#include "cpu/reg.h"
+#include "memory/memory.h"
+#include "memory/dirty.h"
+#include "memory/mtrace.h"
+#include "monitor/watchpoint.h"
+#include "monitor/itrace.h"
+#include "monitor/callgrind.h"
+#include "monitor/hashtrace.h"
+#include "monitor/perf.h"
+#include "device/mmio.h"
 
 uint32_t dram_read(hwaddr_t, size_t);
 void dram_write(hwaddr_t, size_t, uint32_t);
 
+int16_t pmem_map[NR_PMEM_PAGE];
+
+/* Physical memory map */
+
+void init_pmem_map() {
+	int i;
+	for(i = 0; i < NR_PMEM_PAGE; i ++) {
+		pmem_map[i] = PMEM_UNMAPPED;
+	}
+	pmem_set_map(0, hw_mem_size, PMEM_RAM);
+#ifdef USE_RAMDISK
+	pmem_set_map(RAMDISK_START, RAMDISK_SIZE, PMEM_RAM);
+#endif
+}
+
+void pmem_set_map(hwaddr_t addr, size_t len, int map_NO) {
+	Assert((addr & (PMEM_PAGE_SIZE - 1)) == 0, "physical region 0x%08x is not page aligned", addr);
+	assert(len > 0 && map_NO >= PMEM_UNMAPPED && map_NO <= INT16_MAX);
+
+	uint32_t first = addr >> PMEM_PAGE_SHIFT;
+	uint32_t last = (uint32_t)(addr + len - 1) >> PMEM_PAGE_SHIFT;
+	uint32_t i;
+	for(i = first; i <= last; i ++) {
+		pmem_map[i] = map_NO;
+	}
+}
+
+/* Return the host address of guest RAM at `addr', and shrink `*len' to
+ * the part which is RAM, or NULL if `addr' is not RAM. This is for the
+ * monitor to access a block of memory at once, the caller should take
+ * care of the dirty pages and the row buffers of DRAM when writing.
+ */
+void *pmem_host_ptr(hwaddr_t addr, size_t *len) {
+	if(pmem_map[addr >> PMEM_PAGE_SHIFT] != PMEM_RAM) {
+		return NULL;
+	}
+
+	uint64_t end = (uint64_t)addr + *len;
+	uint64_t p = ((uint64_t)addr & ~(PMEM_PAGE_SIZE - 1)) + PMEM_PAGE_SIZE;
+	while(p < end && (p >> PMEM_PAGE_SHIFT) < NR_PMEM_PAGE && pmem_map[p >> PMEM_PAGE_SHIFT] == PMEM_RAM) {
+		p += PMEM_PAGE_SIZE;
+	}
+	if(p < end) {
+		*len = p - addr;
+	}
+	return hwa_to_va(addr);
+}
+
 /* Memory accessing interfaces */
 
 uint32_t hwaddr_read(hwaddr_t addr, size_t len) {
-	return dram_read(addr, len) & (~0u >> ((4 - len) << 3));
+	int map_NO = pmem_map[addr >> PMEM_PAGE_SHIFT];
+	if(map_NO == PMEM_RAM) {
+		return dram_read(addr, len) & (~0u >> ((4 - len) << 3));
+	}
+
+	Assert(map_NO != PMEM_UNMAPPED, "physical address 0x%08x is not mapped", addr);
+	return mmio_read(addr, len, map_NO);
 }
 
 void hwaddr_write(hwaddr_t addr, size_t len, uint32_t data) {
-	dram_write(addr, len, data);
+	int map_NO = pmem_map[addr >> PMEM_PAGE_SHIFT];
+	if(map_NO == PMEM_RAM) {
+		dirty_mark(addr, len);
+		dram_write(addr, len, data);
+		return;
+	}
+
+	Assert(map_NO != PMEM_UNMAPPED, "physical address 0x%08x is not mapped", addr);
+	mmio_write(addr, len, data, map_NO);
 }
 
 uint32_t lnaddr_read(lnaddr_t addr, size_t len) {
@@ -21,17 +93,76 @@ void lnaddr_write(lnaddr_t addr, size_t len, uint32_t data) {
 	hwaddr_write(addr, len, data);
 }
 
-uint32_t swaddr_read(swaddr_t addr, size_t len) {
+/* Translate a virtual address with the descriptor cached in the segment
+ * register. Flat segments are the common case and need no translation.
+ */
+static inline lnaddr_t seg_translate(swaddr_t addr, size_t len, uint8_t sreg) {
+	SegReg *s = &cpu.sreg[sreg];
+	if(s->flat) {
+		return addr;
+	}
+
+	Assert(addr <= s->limit && len - 1 <= s->limit - addr,
+			"%s:0x%08x is outside of the segment limit 0x%08x", sregs[sreg], addr, s->limit);
+	return s->base + addr;
+}
+
+lnaddr_t swaddr_translate(swaddr_t addr, size_t len, uint8_t sreg) {
+	return seg_translate(addr, len, sreg);
+}
+
+/* The accesses of the instructions being executed, which are sampled by
+ * mtrace and seen by the watchpoints, the tracers and the counters. The
+ * monitor uses swaddr_read_raw() and swaddr_write_raw() instead.
+ */
+uint32_t swaddr_read(swaddr_t addr, size_t len, uint8_t sreg) {
 #ifdef DEBUG
 	assert(len == 1 || len == 2 || len == 4);
 #endif
-	return lnaddr_read(addr, len);
+	mtrace_sample(addr, len, sreg, false);
+	wp_access(addr, len, sreg, false);
+	if(sreg != R_CS) { callgrind_mem(false); }
+	perf_access(sreg == R_CS ? PERF_FETCH : PERF_READ, len);
+	return lnaddr_read(seg_translate(addr, len, sreg), len);
+}
+
+/* Read memory for the monitor, such as `x', `bt' and the conditions of
+ * breakpoints and watchpoints. It is not an access of the program, so no
+ * tracer, counter or device sees it. Only RAM is read, directly to leave
+ * the row buffers of DRAM alone, the other bytes read as zero.
+ */
+uint32_t swaddr_read_raw(swaddr_t addr, size_t len, uint8_t sreg) {
+	lnaddr_t lnaddr = seg_translate(addr, len, sreg);
+	uint32_t data = 0;
+	size_t i = 0;
+	while(i < len) {
+		size_t n = len - i;
+		uint8_t *p = pmem_host_ptr(lnaddr + i, &n);
+		if(p != NULL) { memcpy((uint8_t *)&data + i, p, n); }
+		else { n = 1; }
+		i += n;
+	}
+	return data;
+}
+
+/* Write memory for the monitor, unseen by the tracers and counters of the
+ * program. A write to memory-mapped I/O still reaches the device, and the
+ * page is still marked dirty.
+ */
+void swaddr_write_raw(swaddr_t addr, size_t len, uint32_t data, uint8_t sreg) {
+	lnaddr_write(seg_translate(addr, len, sreg), len, data);
 }
 
-void swaddr_write(swaddr_t addr, size_t len, uint32_t data) {
+void swaddr_write(swaddr_t addr, size_t len, uint32_t data, uint8_t sreg) {
 #ifdef DEBUG
 	assert(len == 1 || len == 2 || len == 4);
 #endif
-	lnaddr_write(addr, len, data);
+	mtrace_sample(addr, len, sreg, true);
+	wp_access(addr, len, sreg, true);
+	itrace_write(addr, len, data);
+	hashtrace_write(addr, len, data);
+	callgrind_mem(true);
+	perf_access(PERF_WRITE, len);
+	lnaddr_write(seg_translate(addr, len, sreg), len, data);
 }
 
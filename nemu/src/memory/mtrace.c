@@ -0,0 +1,130 @@
+#include "nemu.h"
+#include "memory/mtrace.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <pthread.h>
+
+/* Records are collected into chunks of a ring. A full chunk is handed
+ * over to the writer thread, so that the CPU never waits for the file.
+ * If the writer falls behind, the samples of a chunk are dropped.
+ */
+#define MTRACE_CHUNK_LEN (1 << 14)
+#define NR_MTRACE_CHUNK 16
+
+uint32_t mtrace_countdown = -1;
+
+static MTraceRecord ring[NR_MTRACE_CHUNK][MTRACE_CHUNK_LEN];
+static uint32_t fill;
+/* chunks published by the CPU and chunks written by the writer */
+static uint32_t head, tail;
+static uint64_t nr_dropped;
+
+static bool tracing = false, stopping;
+static uint32_t sample_rate;
+static FILE *mtrace_fp;
+static pthread_t writer;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+static void *writer_thread(void *arg) {
+	while(1) {
+		pthread_mutex_lock(&lock);
+		while(__atomic_load_n(&head, __ATOMIC_ACQUIRE) == tail && !stopping) {
+			pthread_cond_wait(&cond, &lock);
+		}
+		bool stop = (__atomic_load_n(&head, __ATOMIC_ACQUIRE) == tail);
+		pthread_mutex_unlock(&lock);
+		if(stop) { break; }
+
+		fwrite(ring[tail % NR_MTRACE_CHUNK], sizeof(MTraceRecord), MTRACE_CHUNK_LEN, mtrace_fp);
+		__atomic_store_n(&tail, tail + 1, __ATOMIC_RELEASE);
+	}
+	return NULL;
+}
+
+static void publish_chunk() {
+	if(head - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) == NR_MTRACE_CHUNK - 1) {
+		/* The chunk after this one is still being written. */
+		nr_dropped += MTRACE_CHUNK_LEN;
+	}
+	else {
+		pthread_mutex_lock(&lock);
+		__atomic_store_n(&head, head + 1, __ATOMIC_RELEASE);
+		pthread_cond_signal(&cond);
+		pthread_mutex_unlock(&lock);
+	}
+	fill = 0;
+}
+
+void mtrace_record(swaddr_t addr, size_t len, uint8_t sreg, bool is_write) {
+	if(!tracing) {
+		mtrace_countdown = -1;
+		return;
+	}
+
+	MTraceRecord *r = &ring[head % NR_MTRACE_CHUNK][fill ++];
+	r->eip = cpu.eip;
+	r->addr = addr;
+	r->len = len;
+	/* Instructions are fetched through CS, see instr_fetch(). */
+	r->type = (is_write ? MTRACE_WRITE : (sreg == R_CS ? MTRACE_FETCH : MTRACE_READ));
+	if(fill == MTRACE_CHUNK_LEN) {
+		publish_chunk();
+	}
+
+	mtrace_countdown = sample_rate;
+}
+
+/* Sample one of every `rate' memory accesses into `file'. */
+bool mtrace_start(const char *file, uint32_t rate) {
+	assert(rate > 0);
+	if(tracing) { mtrace_stop(); }
+
+	mtrace_fp = fopen(file, "wb");
+	if(mtrace_fp == NULL) {
+		printf("Can not open '%s'\n", file);
+		return false;
+	}
+
+	MTraceHeader h = { MTRACE_MAGIC, rate };
+	fwrite(&h, sizeof(h), 1, mtrace_fp);
+
+	fill = head = tail = 0;
+	nr_dropped = 0;
+	stopping = false;
+	sample_rate = rate;
+	int ret = pthread_create(&writer, NULL, writer_thread, NULL);
+	Assert(ret == 0, "Can not create the writer thread for memory trace");
+
+	static bool registered = false;
+	if(!registered) {
+		/* Do not lose the trace when NEMU exits. */
+		atexit(mtrace_stop);
+		registered = true;
+	}
+
+	tracing = true;
+	mtrace_countdown = rate;
+	return true;
+}
+
+void mtrace_stop() {
+	if(!tracing) { return; }
+	tracing = false;
+	mtrace_countdown = -1;
+
+	pthread_mutex_lock(&lock);
+	stopping = true;
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+	pthread_join(writer, NULL);
+
+	/* the partial chunk */
+	fwrite(ring[head % NR_MTRACE_CHUNK], sizeof(MTraceRecord), fill, mtrace_fp);
+	fclose(mtrace_fp);
+
+	if(nr_dropped > 0) {
+		printf("%" PRIu64 " samples are dropped because the trace file is too slow\n", nr_dropped);
+	}
+}
@@ -0,0 +1,61 @@
+#include "nemu.h"
+#include "../../../lib-common/x86-inc/mmu.h"
+
+/* Before any segment register is written, all segments are flat.
+ * Real mode is not supported, so this also describes the state after reset.
+ */
+void init_sreg() {
+	int i;
+	for(i = R_ES; i <= R_GS; i ++) {
+		cpu.sreg[i].selector = 0;
+		cpu.sreg[i].base = 0;
+		cpu.sreg[i].limit = 0xffffffff;
+		cpu.sreg[i].type = 0;
+		cpu.sreg[i].flat = true;
+	}
+
+	cpu.gdtr.limit = 0;
+	cpu.gdtr.base = 0;
+	cpu.cr0.val = 0;
+}
+
+/* Write the selector of a segment register and reload its hidden part
+ * from the GDT. This is the only place where descriptors are read from
+ * memory, memory accesses only use the cached copy.
+ */
+void load_sreg(uint8_t sreg, uint16_t selector) {
+	Assert(cpu.cr0.protect_enable, "loading %s in real mode is not supported", sregs[sreg]);
+
+	SegReg *s = &cpu.sreg[sreg];
+	s->selector = selector;
+
+	uint32_t index = selector >> 3;
+	if(index == 0) {
+		/* null selector, any access through this segment will fail */
+		s->base = 0;
+		s->limit = 0;
+		s->type = 0;
+		s->flat = false;
+		return;
+	}
+
+	Assert((index << 3) + 7 <= cpu.gdtr.limit, "selector 0x%04x is outside of the GDT", selector);
+
+	SegDesc desc;
+	uint32_t raw[2];
+	lnaddr_t desc_addr = cpu.gdtr.base + (index << 3);
+	raw[0] = lnaddr_read(desc_addr, 4);
+	raw[1] = lnaddr_read(desc_addr + 4, 4);
+	memcpy(&desc, raw, sizeof(desc));
+	Assert(desc.present, "segment descriptor 0x%04x is not present", selector);
+
+	uint32_t limit = desc.limit_15_0 | (desc.limit_19_16 << 16);
+	if(desc.granularity) {
+		limit = (limit << 12) | 0xfff;
+	}
+
+	s->base = desc.base_15_0 | (desc.base_23_16 << 16) | (desc.base_31_24 << 24);
+	s->limit = limit;
+	s->type = desc.type | (desc.segment_type << 4);
+	s->flat = (s->base == 0 && s->limit == 0xffffffff);
+}
@@ -0,0 +1,99 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/batch.h"
+#include "monitor/perf.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/time.h>
+
+/* The program runs in batches of instructions, so that a timeout which
+ * comes between two batches is noticed soon.
+ */
+#define BATCH_INSNS (1 << 24)
+
+void cpu_exec(uint32_t);
+
+static bool batch = false;
+static uint64_t max_instr = 0;
+static uint32_t timeout_s = 0;
+static const char *stats_file = NULL;
+static bool exit_code = false;
+static volatile sig_atomic_t timed_out = 0;
+
+void init_batch(uint64_t max, uint32_t timeout, const char *stats, bool code) {
+	batch = true;
+	max_instr = max;
+	timeout_s = timeout;
+	stats_file = stats;
+	exit_code = code;
+}
+
+bool batch_enabled() {
+	return batch;
+}
+
+/* The program is stopped at the next instruction. */
+static void batch_timeout(int sig) {
+	timed_out = 1;
+	nemu_state = STOP;
+}
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+static const char *result() {
+	if(nemu_state == END) { return (cpu.eax == 0 ? "good-trap" : "bad-trap"); }
+	if(timed_out) { return "timeout"; }
+	return "max-insns";
+}
+
+static void write_stats(double time) {
+	FILE *fp = fopen(stats_file, "w");
+	Assert(fp, "Can not open '%s'", stats_file);
+	fprintf(fp, "result %s\n", result());
+	fprintf(fp, "insns %" PRIu64 "\n", instr_count);
+	fprintf(fp, "time %.6f\n", time);
+	fprintf(fp, "mips %.3f\n", (time > 0 ? instr_count / time / 1e6 : 0));
+	fprintf(fp, "eip 0x%08x\n", cpu.eip);
+	fprintf(fp, "eax 0x%08x\n", cpu.eax);
+	fclose(fp);
+}
+
+/* Run the program to the end without the user interface, or until it
+ * executes `max_instr' instructions or runs out of time.
+ */
+void batch_mainloop() {
+	if(timeout_s > 0) {
+		struct itimerval it = { { 0, 0 }, { timeout_s, 0 } };
+		signal(SIGALRM, batch_timeout);
+		setitimer(ITIMER_REAL, &it, NULL);
+	}
+
+	double start = now();
+	while(nemu_state != END && !timed_out) {
+		uint64_t left = (max_instr ? max_instr - instr_count : -1);
+		if(left == 0) { break; }
+		cpu_exec(left < BATCH_INSNS ? left : BATCH_INSNS);
+	}
+	double time = now() - start;
+
+	if(nemu_state != END) {
+		fprintf(stderr, "nemu: stopped by %s at eip = 0x%08x after %" PRIu64 " instructions\n",
+				result(), cpu.eip, instr_count);
+	}
+	if(stats_file) {
+		write_stats(time);
+	}
+
+	fflush(stdout);
+	perf_print(stderr);
+	if(!exit_code) { exit(0); }
+	if(nemu_state != END) { exit(BATCH_NOT_END); }
+	exit(cpu.eax == 0 ? BATCH_GOOD_TRAP : BATCH_BAD_TRAP);
+}
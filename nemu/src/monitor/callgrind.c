@@ -0,0 +1,216 @@
+#include "nemu.h"
+#include "monitor/callgrind.h"
+#include "monitor/elf.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+#define CG_MAX_DEPTH 1024
+#define CG_EMPTY_KEY (~0ull)
+
+CGEntry *callgrind_cur = NULL;
+bool callgrind_on = false;
+uint64_t callgrind_total[NR_CG_EVENT];
+
+/* open addressing hash tables of instructions and of call edges */
+typedef struct {
+	CGEntry *entry;
+	uint32_t size, nr;
+} CGTable;
+
+static CGTable instrs, edges;
+
+/* The shadow call stack. The inclusive cost of a call is the difference
+ * of the total cost between the call and the matching return.
+ */
+typedef struct {
+	swaddr_t site, callee, ret_addr;
+	uint64_t start[NR_CG_EVENT];
+} CGFrame;
+
+static CGFrame stack[CG_MAX_DEPTH];
+static int depth;
+
+static void table_init(CGTable *t, uint32_t size) {
+	free(t->entry);
+	t->size = size;
+	t->nr = 0;
+	t->entry = malloc(size * sizeof(CGEntry));
+	assert(t->entry);
+	uint32_t i;
+	for(i = 0; i < size; i ++) {
+		t->entry[i].key = CG_EMPTY_KEY;
+	}
+}
+
+static CGEntry *table_slot(CGTable *t, uint64_t key) {
+	uint32_t i = (key * 0x9e3779b97f4a7c15ull) >> 40;
+	while(1) {
+		i &= t->size - 1;
+		if(t->entry[i].key == key || t->entry[i].key == CG_EMPTY_KEY) { return &t->entry[i]; }
+		i ++;
+	}
+}
+
+static CGEntry *table_get(CGTable *t, uint64_t key) {
+	CGEntry *e = table_slot(t, key);
+	if(e->key == key) { return e; }
+
+	if((t->nr + 1) * 2 > t->size) {
+		CGTable old = *t;
+		t->entry = NULL;
+		table_init(t, old.size * 2);
+		uint32_t i;
+		for(i = 0; i < old.size; i ++) {
+			if(old.entry[i].key != CG_EMPTY_KEY) {
+				*table_slot(t, old.entry[i].key) = old.entry[i];
+				t->nr ++;
+			}
+		}
+		free(old.entry);
+		e = table_slot(t, key);
+	}
+
+	memset(e, 0, sizeof(*e));
+	e->key = key;
+	t->nr ++;
+	return e;
+}
+
+void callgrind_begin_record(swaddr_t eip) {
+	callgrind_cur = table_get(&instrs, eip);
+}
+
+void callgrind_call_record(swaddr_t callee, swaddr_t site, swaddr_t ret_addr) {
+	if(depth == CG_MAX_DEPTH) { return; }
+	CGFrame *f = &stack[depth ++];
+	f->site = site;
+	f->callee = callee;
+	f->ret_addr = ret_addr;
+	memcpy(f->start, callgrind_total, sizeof(f->start));
+}
+
+void callgrind_ret_record(swaddr_t ret_addr) {
+	int i;
+	for(i = depth - 1; i >= 0 && stack[i].ret_addr != ret_addr; i --);
+	if(i < 0) { return; }
+
+	/* The frames above are left without return. */
+	while(depth > i) {
+		CGFrame *f = &stack[-- depth];
+		CGEntry *e = table_get(&edges, (uint64_t)f->site << 32 | f->callee);
+		e->calls ++;
+		int j;
+		for(j = 0; j < NR_CG_EVENT; j ++) {
+			e->cost[j] += callgrind_total[j] - f->start[j];
+		}
+	}
+}
+
+void callgrind_start() {
+	table_init(&instrs, 4096);
+	table_init(&edges, 1024);
+	memset(callgrind_total, 0, sizeof(callgrind_total));
+	depth = 0;
+	callgrind_on = true;
+}
+
+void callgrind_stop() {
+	callgrind_on = false;
+	callgrind_cur = NULL;
+}
+
+/* Output */
+
+typedef struct {
+	swaddr_t func;
+	swaddr_t addr;
+	CGEntry *e;
+	bool is_edge;
+} CGItem;
+
+/* Instructions out of any function are a function of their own. */
+static swaddr_t func_of(swaddr_t addr) {
+	const Elf32_Sym *sym = find_symbol(addr, STT_FUNC);
+	return (sym ? sym->st_value : addr);
+}
+
+static const char *func_name(swaddr_t func, char *buf) {
+	const Elf32_Sym *sym = find_symbol(func, STT_FUNC);
+	if(sym && sym->st_value == func) { return strtab + sym->st_name; }
+	sprintf(buf, "0x%08x", func);
+	return buf;
+}
+
+static int cmp_item(const void *a, const void *b) {
+	const CGItem *x = a, *y = b;
+	if(x->func != y->func) { return (x->func > y->func) - (x->func < y->func); }
+	if(x->is_edge != y->is_edge) { return x->is_edge - y->is_edge; }
+	return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+static void print_cost(FILE *fp, swaddr_t addr, const uint64_t *cost) {
+	fprintf(fp, "0x%x", addr);
+	int j;
+	for(j = 0; j < NR_CG_EVENT; j ++) {
+		fprintf(fp, " %" PRIu64, cost[j]);
+	}
+	fprintf(fp, "\n");
+}
+
+/* Write the profile in the format of callgrind. The costs of calls still
+ * running are not included in their edges.
+ */
+bool callgrind_dump(const char *file) {
+	if(instrs.entry == NULL) {
+		printf("No profile.\n");
+		return false;
+	}
+	FILE *fp = fopen(file, "w");
+	if(fp == NULL) {
+		printf("Can not open '%s'\n", file);
+		return false;
+	}
+
+	uint32_t nr = instrs.nr + edges.nr, n = 0, i;
+	CGItem *items = malloc((nr ? nr : 1) * sizeof(CGItem));
+	assert(items);
+	for(i = 0; i < instrs.size; i ++) {
+		CGEntry *e = &instrs.entry[i];
+		if(e->key != CG_EMPTY_KEY) { items[n ++] = (CGItem) { func_of(e->key), e->key, e, false }; }
+	}
+	for(i = 0; i < edges.size; i ++) {
+		CGEntry *e = &edges.entry[i];
+		if(e->key != CG_EMPTY_KEY) { items[n ++] = (CGItem) { func_of(e->key >> 32), e->key >> 32, e, true }; }
+	}
+	qsort(items, n, sizeof(CGItem), cmp_item);
+
+	fprintf(fp, "version: 1\ncreator: nemu\ncmd: %s\n", exec_file);
+	fprintf(fp, "positions: instr\nevents: Ir Dr Dw Bt\n");
+	fprintf(fp, "event: Bt : Taken branches\n");
+	fprintf(fp, "summary: %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 "\n\n",
+			callgrind_total[CG_IR], callgrind_total[CG_DR], callgrind_total[CG_DW], callgrind_total[CG_BT]);
+	fprintf(fp, "ob=%s\nfl=%s\n", exec_file, exec_file);
+
+	char buf[16];
+	for(i = 0; i < n; i ++) {
+		CGItem *it = &items[i];
+		if(i == 0 || it->func != items[i - 1].func) {
+			fprintf(fp, "\nfn=%s\n", func_name(it->func, buf));
+		}
+		if(!it->is_edge) {
+			print_cost(fp, it->addr, it->e->cost);
+			continue;
+		}
+
+		swaddr_t callee = (uint32_t)it->e->key;
+		fprintf(fp, "cfn=%s\n", func_name(func_of(callee), buf));
+		fprintf(fp, "calls=%" PRIu64 " 0x%x\n", it->e->calls, callee);
+		print_cost(fp, it->addr, it->e->cost);
+	}
+
+	free(items);
+	fclose(fp);
+	printf("Profile of %" PRIu64 " instructions written to '%s'\n", callgrind_total[CG_IR], file);
+	return true;
+}
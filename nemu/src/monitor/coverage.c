@@ -0,0 +1,65 @@
+#include "nemu.h"
+#include "monitor/coverage.h"
+
+#include <stdlib.h>
+
+bool coverage_on = false;
+
+static uint8_t *chunks[COVERAGE_NR_CHUNK];
+static uint32_t nr_chunk = 0, nr_block = 0;
+
+void coverage_mark(swaddr_t eip) {
+	uint8_t **c = &chunks[eip >> COVERAGE_CHUNK_POW2];
+	if(*c == NULL) {
+		*c = calloc(COVERAGE_CHUNK_BYTES, 1);
+		assert(*c);
+		nr_chunk ++;
+	}
+
+	uint32_t off = eip & ((1 << COVERAGE_CHUNK_POW2) - 1);
+	uint8_t bit = 1 << (off & 7);
+	if(!((*c)[off >> 3] & bit)) {
+		(*c)[off >> 3] |= bit;
+		nr_block ++;
+	}
+}
+
+/* The blocks marked before are kept, so that the coverage of several
+ * parts of a run can be collected. A block is only marked when it is
+ * entered by a control transfer, or when the program is loaded, so the
+ * block being executed when the coverage is turned on is not marked.
+ */
+void coverage_start() {
+	coverage_on = true;
+}
+
+void coverage_stop() {
+	coverage_on = false;
+}
+
+bool coverage_dump(const char *file) {
+	FILE *fp = fopen(file, "w");
+	if(fp == NULL) {
+		printf("Can not open '%s'\n", file);
+		return false;
+	}
+
+	CoverageHeader h = { COVERAGE_MAGIC, COVERAGE_CHUNK_POW2, nr_chunk };
+	fwrite(&h, sizeof(h), 1, fp);
+
+	uint32_t i;
+	for(i = 0; i < COVERAGE_NR_CHUNK; i ++) {
+		if(chunks[i] == NULL) { continue; }
+		fwrite(&i, sizeof(i), 1, fp);
+		fwrite(chunks[i], COVERAGE_CHUNK_BYTES, 1, fp);
+	}
+	bool ok = !ferror(fp);
+	ok = (fclose(fp) == 0 && ok);
+	if(!ok) {
+		printf("Can not write '%s'\n", file);
+		return false;
+	}
+
+	printf("%u basic blocks covered, written to '%s'\n", nr_block, file);
+	return true;
+}
@@ -1,5 +1,13 @@
 #include "monitor/monitor.h"
 #include "monitor/watchpoint.h"
+#include "monitor/breakpoint.h"
+#include "monitor/fuzz.h"
+#include "monitor/itrace.h"
+#include "monitor/profile.h"
+#include "monitor/callgrind.h"
+#include "monitor/reverse.h"
+#include "monitor/perf.h"
+#include "monitor/hashtrace.h"
 #include "cpu/helper.h"
 #include <setjmp.h>
 
@@ -11,6 +19,7 @@
 #define MAX_INSTR_TO_PRINT 1000
 
 int nemu_state = STOP;
+uint64_t instr_count = 0;
 
 int exec(swaddr_t);
 
@@ -24,7 +33,7 @@ void print_bin_instr(swaddr_t eip, int len) {
 	int i;
 	int l = sprintf(asm_buf, "%8x:   ", eip);
 	for(i = 0; i < len; i ++) {
-		l += sprintf(asm_buf + l, "%02x ", instr_fetch(eip + i, 1));
+		l += sprintf(asm_buf + l, "%02x ", swaddr_read_raw(eip + i, 1, R_CS));
 	}
 	sprintf(asm_buf + l, "%*.s", 50 - (12 + 3 * len), "");
 }
@@ -42,6 +51,7 @@ void cpu_exec(volatile uint32_t n) {
 		return;
 	}
 	nemu_state = RUNNING;
+	perf_exec_begin();
 
 #ifdef DEBUG
 	volatile uint32_t n_temp = n;
@@ -50,8 +60,8 @@ void cpu_exec(volatile uint32_t n) {
 	setjmp(jbuf);
 
 	for(; n > 0; n --) {
-#ifdef DEBUG
 		swaddr_t eip_temp = cpu.eip;
+#ifdef DEBUG
 		if((n & 0xffff) == 0) {
 			/* Output some dots while executing the program. */
 			fputc('.', stderr);
@@ -60,16 +70,44 @@ void cpu_exec(volatile uint32_t n) {
 
 		/* Execute one instruction, including instruction fetch,
 		 * instruction decode, and the actual execution. */
+		callgrind_begin(cpu.eip);
 		int instr_len = exec(cpu.eip);
+		perf.opcode[ops_decoded.opcode] ++;
 
 		cpu.eip += instr_len;
+		instr_count ++;
+		callgrind_end(cpu.eip != eip_temp + instr_len);
+		reverse_tick();
+
+		if(itrace_cur) {
+			itrace_record(eip_temp, instr_len);
+		}
+		hashtrace_tick(eip_temp);
+
+		profile_tick();
+
+		if(fuzz_branch) {
+			fuzz_branch = false;
+			if(fuzz_area) { fuzz_edge(cpu.eip); }
+			coverage_block(cpu.eip);
+		}
+
+#ifdef HAS_DEVICE
+		/* The events of devices are delivered before the execution may
+		 * stop, so that they do not depend on the breakpoints.
+		 */
+		extern void device_update();
+		device_update();
+#endif
 
 #ifdef DEBUG
-		print_bin_instr(eip_temp, instr_len);
-		strcat(asm_buf, assembly);
-		Log_write("%s\n", asm_buf);
-		if(n_temp < MAX_INSTR_TO_PRINT) {
-			printf("%s\n", asm_buf);
+		if(log_fp || n_temp < MAX_INSTR_TO_PRINT) {
+			print_bin_instr(eip_temp, instr_len);
+			strcat(asm_buf, assembly);
+			Log_write("%s\n", asm_buf);
+			if(n_temp < MAX_INSTR_TO_PRINT) {
+				printf("%s\n", asm_buf);
+			}
 		}
 #endif
 
@@ -78,14 +116,14 @@ void cpu_exec(volatile uint32_t n) {
 			nemu_state = STOP;
 		}
 
+		/* Stop before the instruction at a breakpoint. */
+		if(bp_match(cpu.eip)) {
+			nemu_state = STOP;
+		}
 
-#ifdef HAS_DEVICE
-		extern void device_update();
-		device_update();
-#endif
-
-		if(nemu_state != RUNNING) { return; }
+		if(nemu_state != RUNNING) { break; }
 	}
 
 	if(nemu_state == RUNNING) { nemu_state = STOP; }
+	perf_exec_end();
 }
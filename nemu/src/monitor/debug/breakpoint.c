@@ -0,0 +1,226 @@
+#include "monitor/breakpoint.h"
+#include "monitor/elf.h"
+#include "nemu.h"
+
+#include <stdlib.h>
+
+/* The pool grows by this many breakpoints when it runs out. */
+#define NR_BP 32
+
+static BP *head, *tail, *free_;
+static int next_no;
+
+static BP *bp_table[1 << BP_HASH_POW2];
+uint64_t bp_filter[NR_BP_FILTER_WORD];
+bool bp_hit = false;
+
+static void grow_pool() {
+	BP *pool = malloc(NR_BP * sizeof(BP));
+	assert(pool);
+	int i;
+	for(i = 0; i < NR_BP - 1; i ++) {
+		pool[i].next = &pool[i + 1];
+	}
+	pool[NR_BP - 1].next = free_;
+	free_ = pool;
+}
+
+void init_bp_pool() {
+	head = tail = NULL;
+	free_ = NULL;
+	grow_pool();
+	next_no = 1;
+	memset(bp_table, 0, sizeof(bp_table));
+	memset(bp_filter, 0, sizeof(bp_filter));
+}
+
+/* The breakpoints in a bucket are kept in the order of numbers. */
+static void hash_insert(BP *bp) {
+	uint32_t key = bp_hash(bp->addr);
+	BP **p = &bp_table[key];
+	while (*p) {
+		p = &(*p)->hnext;
+	}
+	*p = bp;
+	bp->hnext = NULL;
+	bp_filter[key >> 6] |= 1ull << (key & 63);
+}
+
+static void hash_remove(BP *bp) {
+	uint32_t key = bp_hash(bp->addr);
+	BP **p = &bp_table[key];
+	while (*p != bp) {
+		p = &(*p)->hnext;
+	}
+	*p = bp->hnext;
+	if (bp_table[key] == NULL) {
+		bp_filter[key >> 6] &= ~(1ull << (key & 63));
+	}
+}
+
+/* `cond' is NULL for an unconditional breakpoint. */
+BP* new_bp(swaddr_t addr, bool temporary, const char *cond) {
+	Expr code;
+	if (cond != NULL && (strlen(cond) >= sizeof(free_->cond) || !expr_compile(cond, &code))) {
+		printf("Invalid condition: %s\n", cond);
+		return NULL;
+	}
+
+	if (free_ == NULL) {
+		grow_pool();
+	}
+	BP *bp = free_;
+	free_ = free_->next;
+
+	/* keep the list in the order of numbers */
+	bp->next = NULL;
+	if (tail) {
+		tail->next = bp;
+	}
+	else {
+		head = bp;
+	}
+	tail = bp;
+
+	bp->NO = next_no++;
+	bp->addr = addr;
+	bp->temporary = temporary;
+	bp->has_cond = (cond != NULL);
+	if (cond != NULL) {
+		strcpy(bp->cond, cond);
+		bp->cond_code = code;
+	}
+	bp->ignore_count = 0;
+	bp->hit_count = 0;
+
+	hash_insert(bp);
+	return bp;
+}
+
+void free_bp(BP *bp) {
+	BP **p = &head, *prev = NULL;
+	while (*p && *p != bp) {
+		prev = *p;
+		p = &(*p)->next;
+	}
+	if (*p == NULL) {
+		return;
+	}
+	*p = bp->next;
+	if (tail == bp) {
+		tail = prev;
+	}
+	hash_remove(bp);
+
+	bp->next = free_;
+	free_ = bp;
+}
+
+BP* find_bp(int no) {
+	BP *bp;
+	for (bp = head; bp; bp = bp->next) {
+		if (bp->NO == no) {
+			return bp;
+		}
+	}
+	return NULL;
+}
+
+BP* find_bp_at(swaddr_t addr) {
+	BP *bp;
+	for (bp = bp_table[bp_hash(addr)]; bp; bp = bp->hnext) {
+		if (bp->addr == addr) {
+			return bp;
+		}
+	}
+	return NULL;
+}
+
+static const char *func_name(swaddr_t addr) {
+	const Elf32_Sym *sym = find_symbol(addr, STT_FUNC);
+	return (sym ? strtab + sym->st_name : "??");
+}
+
+void print_bp() {
+	if (head == NULL) {
+		printf("No breakpoints.\n");
+		return;
+	}
+
+	printf("Num     Type            Disp Enb Address    What\n");
+	BP *bp;
+	for (bp = head; bp; bp = bp->next) {
+		printf("%-8d%-16s%-5s%-4s0x%08x in %s\n", bp->NO, "breakpoint",
+				(bp->temporary ? "del" : "keep"), "y", bp->addr, func_name(bp->addr));
+		if (bp->has_cond) {
+			printf("\tstop only if %s\n", bp->cond);
+		}
+		if (bp->hit_count > 0) {
+			printf("\tbreakpoint already hit %u time%s\n", bp->hit_count, (bp->hit_count > 1 ? "s" : ""));
+		}
+		if (bp->ignore_count > 0) {
+			printf("\tWill ignore next %u crossings of breakpoint.\n", bp->ignore_count);
+		}
+	}
+}
+
+/* Called when the bucket of `eip' has breakpoints. The condition is only
+ * evaluated here, at the address of the breakpoint.
+ */
+bool check_breakpoints(swaddr_t eip) {
+	bool stop = false;
+	BP *bp = bp_table[bp_hash(eip)];
+	while (bp) {
+		BP *next = bp->hnext;
+		if (bp->addr != eip) {
+			bp = next;
+			continue;
+		}
+
+		if (bp->has_cond) {
+			bool success;
+			uint32_t val = expr_eval(&bp->cond_code, &success);
+			if (success && val == 0) {
+				bp = next;
+				continue;
+			}
+		}
+
+		bp->hit_count++;
+		if (bp->ignore_count > 0) {
+			bp->ignore_count--;
+			bp = next;
+			continue;
+		}
+
+		printf("\n%s %d, 0x%08x in %s ()\n", (bp->temporary ? "Temporary breakpoint" : "Breakpoint"),
+				bp->NO, eip, func_name(eip));
+		stop = bp_hit = true;
+		if (bp->temporary) {
+			free_bp(bp);
+		}
+		bp = next;
+	}
+	return stop;
+}
+
+/* Whether a breakpoint at `eip' would stop the execution, ignoring the
+ * ignore counts.
+ */
+bool test_breakpoints(swaddr_t eip) {
+	BP *bp;
+	for (bp = bp_table[bp_hash(eip)]; bp; bp = bp->hnext) {
+		if (bp->addr != eip) {
+			continue;
+		}
+		if (bp->has_cond) {
+			bool success;
+			uint32_t val = expr_eval(&bp->cond_code, &success);
+			if (success && val == 0) {
+				continue;
+			}
+		}
+		return true;
+	}
+	return false;
+}
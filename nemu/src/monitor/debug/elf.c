@@ -1,6 +1,11 @@
 #include "common.h"
+#include "monitor/elf.h"
 #include <stdlib.h>
 #include <elf.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 char *exec_file = NULL;
 
@@ -8,20 +13,172 @@ char *strtab = NULL;
 Elf32_Sym *symtab = NULL;
 int nr_symtab_entry;
 
-void load_elf_tables(int argc, char *argv[]) {
-	int ret;
-	Assert(argc == 2, "run NEMU with format 'nemu [program]'");
-	exec_file = argv[1];
+/* Functions and objects sorted by address. For each of them, the largest
+ * end address among it and the ones before, so that the search for an
+ * enclosing symbol can stop early. The last symbol found is the answer for
+ * the addresses from its start to `last_end'.
+ */
+typedef struct {
+	Elf32_Sym **sym;
+	uint64_t *max_end;
+	int nr;
+	Elf32_Sym *last;
+	uint64_t last_end;
+} SymIndex;
+
+static SymIndex func_index, obj_index;
+
+/* open addressing hash table from names to functions and objects */
+static Elf32_Sym **name_table;
+static uint32_t name_table_size;
+
+static uint32_t hash_name(const char *name, int len) {
+	uint32_t h = 2166136261u;
+	int i;
+	for(i = 0; i < len; i ++) {
+		h = (h ^ (uint8_t)name[i]) * 16777619u;
+	}
+	return h;
+}
+
+static int cmp_sym_addr(const void *a, const void *b) {
+	const Elf32_Sym *x = *(Elf32_Sym **)a, *y = *(Elf32_Sym **)b;
+	return (x->st_value > y->st_value) - (x->st_value < y->st_value);
+}
+
+static bool indexed_type(const Elf32_Sym *sym) {
+	int type = ELF32_ST_TYPE(sym->st_info);
+	return (type == STT_FUNC || type == STT_OBJECT) && sym->st_name != 0;
+}
+
+static uint64_t sym_end(const Elf32_Sym *sym) {
+	return (uint64_t)sym->st_value + sym->st_size;
+}
+
+static void sort_index(SymIndex *idx) {
+	qsort(idx->sym, idx->nr, sizeof(Elf32_Sym *), cmp_sym_addr);
+	int i;
+	for(i = 0; i < idx->nr; i ++) {
+		uint64_t end = sym_end(idx->sym[i]);
+		idx->max_end[i] = (i > 0 && idx->max_end[i - 1] > end ? idx->max_end[i - 1] : end);
+	}
+}
+
+static void build_index() {
+	func_index.sym = malloc(nr_symtab_entry * sizeof(Elf32_Sym *));
+	obj_index.sym = malloc(nr_symtab_entry * sizeof(Elf32_Sym *));
+	func_index.max_end = malloc(nr_symtab_entry * sizeof(uint64_t));
+	obj_index.max_end = malloc(nr_symtab_entry * sizeof(uint64_t));
+	assert(func_index.sym && obj_index.sym && func_index.max_end && obj_index.max_end);
+
+	for(name_table_size = 16; name_table_size < 2 * nr_symtab_entry; name_table_size *= 2);
+	name_table = calloc(name_table_size, sizeof(Elf32_Sym *));
+	assert(name_table);
+
+	int i;
+	for(i = 0; i < nr_symtab_entry; i ++) {
+		Elf32_Sym *sym = &symtab[i];
+		if(!indexed_type(sym)) { continue; }
+
+		/* Symbols without a size contain no address. */
+		if(sym->st_size != 0) {
+			SymIndex *idx = (ELF32_ST_TYPE(sym->st_info) == STT_FUNC ? &func_index : &obj_index);
+			idx->sym[idx->nr ++] = sym;
+		}
+
+		/* The first symbol with a name wins. */
+		const char *name = strtab + sym->st_name;
+		uint32_t h = hash_name(name, strlen(name));
+		while(name_table[h & (name_table_size - 1)] != NULL &&
+				strcmp(strtab + name_table[h & (name_table_size - 1)]->st_name, name) != 0) {
+			h ++;
+		}
+		if(name_table[h & (name_table_size - 1)] == NULL) {
+			name_table[h & (name_table_size - 1)] = sym;
+		}
+	}
+
+	sort_index(&func_index);
+	sort_index(&obj_index);
+}
+
+static bool sym_contains(const Elf32_Sym *sym, swaddr_t addr) {
+	return addr >= sym->st_value && addr - sym->st_value < sym->st_size;
+}
+
+/* Find the function (STT_FUNC) or object (STT_OBJECT) containing `addr'.
+ * Symbols may be nested, such as the local labels some assembly code gives
+ * a size to, so the innermost one, which starts last, is returned.
+ */
+const Elf32_Sym *find_symbol(swaddr_t addr, int type) {
+	SymIndex *idx = (type == STT_FUNC ? &func_index : &obj_index);
+	if(idx->last != NULL && addr >= idx->last->st_value && addr < idx->last_end) {
+		return idx->last;
+	}
+
+	int l = 0, r = idx->nr - 1;
+	while(l <= r) {
+		int m = (l + r) / 2;
+		if(idx->sym[m]->st_value <= addr) { l = m + 1; }
+		else { r = m - 1; }
+	}
 
-	FILE *fp = fopen(exec_file, "rb");
-	Assert(fp, "Can not open '%s'", exec_file);
+	int k;
+	for(k = r; k >= 0 && idx->max_end[k] > addr; k --) {
+		if(sym_contains(idx->sym[k], addr)) { break; }
+	}
+	if(k < 0 || idx->max_end[k] <= addr) {
+		return NULL;
+	}
 
-	uint8_t buf[sizeof(Elf32_Ehdr)];
-	ret = fread(buf, sizeof(Elf32_Ehdr), 1, fp);
-	assert(ret == 1);
+	/* The same symbol is found up to the next start, unless an outer one
+	 * is found since the closest start does not contain `addr'. */
+	if(k == r) {
+		idx->last = idx->sym[r];
+		idx->last_end = sym_end(idx->sym[r]);
+		if(r + 1 < idx->nr && idx->sym[r + 1]->st_value < idx->last_end) {
+			idx->last_end = idx->sym[r + 1]->st_value;
+		}
+	}
+	return idx->sym[k];
+}
+
+/* Find the function or object with the first `len' characters of `name'. */
+const Elf32_Sym *find_symbol_by_name(const char *name, int len) {
+	if(name_table == NULL) {
+		return NULL;
+	}
+
+	uint32_t h = hash_name(name, len);
+	Elf32_Sym *sym;
+	while((sym = name_table[h & (name_table_size - 1)]) != NULL) {
+		const char *s = strtab + sym->st_name;
+		if(strncmp(s, name, len) == 0 && s[len] == '\0') {
+			return sym;
+		}
+		h ++;
+	}
+	return NULL;
+}
+
+/* The ELF file is mapped read-only and kept mapped, the symbol table and
+ * the string table point into the mapping instead of being copied.
+ */
+void load_elf_tables() {
+	int fd = open(exec_file, O_RDONLY);
+	Assert(fd >= 0, "Can not open '%s'", exec_file);
+
+	struct stat st;
+	int ret = fstat(fd, &st);
+	assert(ret == 0);
+	Assert(st.st_size >= sizeof(Elf32_Ehdr), "'%s' is not an ELF file", exec_file);
+
+	uint8_t *file = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	Assert(file != MAP_FAILED, "Can not map '%s'", exec_file);
+	close(fd);
 
 	/* The first several bytes contain the ELF header. */
-	Elf32_Ehdr *elf = (void *)buf;
+	Elf32_Ehdr *elf = (void *)file;
 	char magic[] = {ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3};
 
 	/* Check ELF header */
@@ -39,45 +196,32 @@ void load_elf_tables(int argc, char *argv[]) {
 
 	/* Load symbol table and string table for future use */
 
-	/* Load section header table */
-	uint32_t sh_size = elf->e_shentsize * elf->e_shnum;
-	Elf32_Shdr *sh = malloc(sh_size);
-	fseek(fp, elf->e_shoff, SEEK_SET);
-	ret = fread(sh, sh_size, 1, fp);
-	assert(ret == 1);
+	/* Locate section header table */
+	assert(elf->e_shoff + elf->e_shentsize * elf->e_shnum <= st.st_size);
+	Elf32_Shdr *sh = (void *)(file + elf->e_shoff);
 
-	/* Load section header string table */
-	char *shstrtab = malloc(sh[elf->e_shstrndx].sh_size);
-	fseek(fp, sh[elf->e_shstrndx].sh_offset, SEEK_SET);
-	ret = fread(shstrtab, sh[elf->e_shstrndx].sh_size, 1, fp);
-	assert(ret == 1);
+	/* Locate section header string table */
+	char *shstrtab = (void *)(file + sh[elf->e_shstrndx].sh_offset);
 
 	int i;
 	for(i = 0; i < elf->e_shnum; i ++) {
 		if(sh[i].sh_type == SHT_SYMTAB && 
 				strcmp(shstrtab + sh[i].sh_name, ".symtab") == 0) {
-			/* Load symbol table from exec_file */
-			symtab = malloc(sh[i].sh_size);
-			fseek(fp, sh[i].sh_offset, SEEK_SET);
-			ret = fread(symtab, sh[i].sh_size, 1, fp);
-			assert(ret == 1);
+			/* Locate symbol table in exec_file */
+			assert(sh[i].sh_offset + sh[i].sh_size <= st.st_size);
+			symtab = (void *)(file + sh[i].sh_offset);
 			nr_symtab_entry = sh[i].sh_size / sizeof(symtab[0]);
 		}
 		else if(sh[i].sh_type == SHT_STRTAB && 
 				strcmp(shstrtab + sh[i].sh_name, ".strtab") == 0) {
-			/* Load string table from exec_file */
-			strtab = malloc(sh[i].sh_size);
-			fseek(fp, sh[i].sh_offset, SEEK_SET);
-			ret = fread(strtab, sh[i].sh_size, 1, fp);
-			assert(ret == 1);
+			/* Locate string table in exec_file */
+			assert(sh[i].sh_offset + sh[i].sh_size <= st.st_size);
+			strtab = (void *)(file + sh[i].sh_offset);
 		}
 	}
 
-	free(sh);
-	free(shstrtab);
-
 	assert(strtab != NULL && symtab != NULL);
 
-	fclose(fp);
+	/* Index the symbols for lookups by address and by name. */
+	build_index();
 }
-
@@ -1,14 +1,15 @@
 #include "nemu.h"
+#include "monitor/expr.h"
+#include "monitor/elf.h"
 
-/* We use the POSIX regex functions to process regular expressions.
- * Type 'man regex' for more information about POSIX regex functions.
- */
-#include <sys/types.h>
-#include <regex.h>
+#include <ctype.h>
 #include <stdlib.h>
-#include <stdio.h>
-#include <string.h>
-#include "monitor/elf.h"
+
+/* An expression is scanned into tokens and compiled once into code for a
+ * stack machine, with registers resolved to slots and symbols to their
+ * addresses. Evaluating the code does not look at the text any more, so
+ * watchpoints can be checked after every instruction cheaply.
+ */
 
 enum {
 	NOTYPE = 256,
@@ -18,7 +19,7 @@ enum {
 	OR,			// 逻辑或
 	NOT,		// 逻辑非（单目运算符）
 	NUMBER,		// 数字
-    IDENT,      // 标识符（变量名）
+	IDENT,		// 标识符（变量名）
 	PLUS,		// 加号
 	MINUS,		// 减号
 	NEG,		// 负号（单目运算符）
@@ -28,187 +29,132 @@ enum {
 	LPAREN,		// 左括号
 	RPAREN,		// 右括号
 	REGISTER	// 寄存器
-	/* TODO: Add more token types */
 };
 
-static struct rule {
-	char *regex;
-	int token_type;
-} rules[] = {
-
-	/* TODO: Add more rules.
-	 * Pay attention to the precedence level of different rules.
-	 */
-
-	{" +", NOTYPE},								// spaces
-	{"&&", AND},								// logical and
-	{"\\|\\|", OR},								// logical or  
-	{"==", EQ},									// equal
-	{"!=", NEQ},								// not equal
-	{"!", NOT},									// logical not
-	{"\\+", PLUS},								// plus
-	{"-", MINUS},								// minus
-	{"\\*", MULTIPLY},							// multiply
-	{"/", DIVIDE},								// divide
-	{"\\(", LPAREN},							// left parenthesis
-	{"\\)", RPAREN},							// right parenthesis
-	{"\\$[a-zA-Z][a-zA-Z0-9]*", REGISTER},		// register like "$eax", "$ebx"
-	{"0[xX][0-9a-fA-F]+", NUMBER},				// hexadecimal number like "0x1F"
-	{"[0-9]+", NUMBER},							// decimal number
-    {"[a-zA-Z_][a-zA-Z0-9_]*", IDENT}           // identifier
-};
-
-#define NR_REGEX (sizeof(rules) / sizeof(rules[0]) )
-
-static regex_t re[NR_REGEX];
-
-/* Rules are used for many times.
- * Therefore we compile them only once before any usage.
- */
-void init_regex() {
-	int i;
-	char error_msg[128];
-	int ret;
-
-	for(i = 0; i < NR_REGEX; i ++) {
-		ret = regcomp(&re[i], rules[i].regex, REG_EXTENDED);
-		if(ret != 0) {
-			regerror(ret, &re[i], error_msg, 128);
-			Assert(ret == 0, "regex compilation failed: %s\n%s", error_msg, rules[i].regex);
-		}
-	}
-}
-
 typedef struct token {
 	int type;
-	char str[32];
+	/* the value of a number or a symbol, or the code to read a register */
+	ExprInsn insn;
 } Token;
 
-Token tokens[32];
-int nr_token;
+static Token tokens[EXPR_MAX_LEN];
+static int nr_token;
 
-// Get register value by register name
-static uint32_t get_register_value(const char *reg_name, bool *success) {
-	// Skip the leading '$' symbol
-	const char *name = reg_name + 1;
+/* Resolve the name of a register, without the leading '$'. */
+static bool resolve_register(const char *name, int len, ExprInsn *insn) {
 	int i;
-	
-	// Check special register first
-	if (strcmp(name, "eip") == 0) {
-		return cpu.eip;
+	if (len == 3 && strncmp(name, "eip", 3) == 0) {
+		insn->op = OP_EIP;
+		return true;
 	}
-	
-	// Check 32-bit registers
+
 	for (i = 0; i < 8; i++) {
-		if (strcmp(name, regsl[i]) == 0) {
-			return reg_l(i);
+		if (strlen(regsl[i]) == len && strncmp(name, regsl[i], len) == 0) {
+			insn->op = OP_REG32; insn->arg = i;
+			return true;
 		}
-	}
-	
-	// Check 16-bit registers  
-	for (i = 0; i < 8; i++) {
-		if (strcmp(name, regsw[i]) == 0) {
-			return reg_w(i);
+		if (strlen(regsw[i]) == len && strncmp(name, regsw[i], len) == 0) {
+			insn->op = OP_REG16; insn->arg = i;
+			return true;
 		}
-	}
-	
-	// Check 8-bit registers
-	for (i = 0; i < 8; i++) {
-		if (strcmp(name, regsb[i]) == 0) {
-			return reg_b(i);
+		if (strlen(regsb[i]) == len && strncmp(name, regsb[i], len) == 0) {
+			insn->op = OP_REG8; insn->arg = i;
+			return true;
 		}
 	}
-	
-	// Invalid register name
-	*success = false;
-	return 0;
+	return false;
 }
 
-static bool make_token(char *e) {
-	int position = 0;
-	int i;
-	regmatch_t pmatch;
-	
-	nr_token = 0;
+/* Both objects and functions can be named in an expression. */
+static bool resolve_symbol(const char *name, int len, uint32_t *addr) {
+	const Elf32_Sym *sym = find_symbol_by_name(name, len);
+	if (sym == NULL) {
+		return false;
+	}
+	*addr = sym->st_value;
+	return true;
+}
 
-	while(e[position] != '\0') {
-		/* Try all rules one by one. */
-		for(i = 0; i < NR_REGEX; i ++) {
-			if(regexec(&re[i], e + position, 1, &pmatch, 0) == 0 && pmatch.rm_so == 0) {
-				char *substr_start = e + position;
-				int substr_len = pmatch.rm_eo;
+/* `*' and `-' are unary unless they follow an operand. */
+static bool after_operand() {
+	if (nr_token == 0) {
+		return false;
+	}
+	int type = tokens[nr_token - 1].type;
+	return type == NUMBER || type == REGISTER || type == IDENT || type == RPAREN;
+}
 
-				Log("match rules[%d] = \"%s\" at position %d with len %d: %.*s", i, rules[i].regex, position, substr_len, substr_len, substr_start);
-				position += substr_len;
+static bool error_at(const char *e, int position, const char *msg) {
+	printf("%s at position %d\n%s\n%*.s^\n", msg, position, e, position, "");
+	return false;
+}
 
-				/* TODO: Now a new token is recognized with rules[i]. Add codes
-				 * to record the token in the array `tokens'. For certain types
-				 * of tokens, some extra actions should be performed.
-				 */
+static bool make_token(const char *e) {
+	int position = 0;
+	nr_token = 0;
 
-				switch(rules[i].token_type) {
-					case NOTYPE:
-						// ignore spaces
-						break;
-					case NUMBER:
-					case REGISTER:
-					case IDENT:
-						tokens[nr_token].type = rules[i].token_type;
-						memset(tokens[nr_token].str, 0, sizeof(tokens[nr_token].str));
-						// ensure not to overflow
-						int copy_len = substr_len > 31 ? 31 : substr_len;
-						strncpy(tokens[nr_token].str, substr_start, copy_len);
-						tokens[nr_token].str[copy_len] = '\0';
-						nr_token++;
-						break;
-					case PLUS:
-					case DIVIDE:
-					case LPAREN:
-					case RPAREN:
-					case EQ:
-					case NEQ:
-					case AND:
-					case OR:
-					case NOT:
-						tokens[nr_token].type = rules[i].token_type;
-						tokens[nr_token].str[0] = '\0';
-						nr_token++;
-						break;
-					case MULTIPLY:
-						// Check if it's dereference or multiply operator
-						// It's dereference if previous token is not number/register/right parenthesis
-						if (nr_token == 0 || 
-							(tokens[nr_token-1].type != NUMBER && tokens[nr_token-1].type != RPAREN && tokens[nr_token-1].type != REGISTER)) {
-							tokens[nr_token].type = DEREF;
-						} else {
-							tokens[nr_token].type = MULTIPLY;
-						}
-						tokens[nr_token].str[0] = '\0';
-						nr_token++;
-						break;
-					case MINUS:
-						// Check if it's negative sign or minus operator
-						// It's negative if previous token is not number/register/right parenthesis
-						if (nr_token == 0 || 
-							(tokens[nr_token-1].type != NUMBER && tokens[nr_token-1].type != RPAREN && tokens[nr_token-1].type != REGISTER)) {
-							tokens[nr_token].type = NEG;
-						} else {
-							tokens[nr_token].type = MINUS;
-						}
-						tokens[nr_token].str[0] = '\0';
-						nr_token++;
-						break;
-					default: panic("please implement me");
-				}
+	while (e[position] != '\0') {
+		const char *s = e + position;
+		if (isspace((unsigned char)*s)) {
+			position++;
+			continue;
+		}
 
-				break;
+		if (nr_token == EXPR_MAX_LEN) {
+			return error_at(e, position, "expression too long");
+		}
+		Token *t = &tokens[nr_token];
+		int len = 1;
+
+		if (strncmp(s, "&&", 2) == 0) { t->type = AND; len = 2; }
+		else if (strncmp(s, "||", 2) == 0) { t->type = OR; len = 2; }
+		else if (strncmp(s, "==", 2) == 0) { t->type = EQ; len = 2; }
+		else if (strncmp(s, "!=", 2) == 0) { t->type = NEQ; len = 2; }
+		else if (*s == '!') { t->type = NOT; }
+		else if (*s == '+') { t->type = PLUS; }
+		else if (*s == '-') { t->type = (after_operand() ? MINUS : NEG); }
+		else if (*s == '*') { t->type = (after_operand() ? MULTIPLY : DEREF); }
+		else if (*s == '/') { t->type = DIVIDE; }
+		else if (*s == '(') { t->type = LPAREN; }
+		else if (*s == ')') { t->type = RPAREN; }
+		else if (isdigit((unsigned char)*s)) {
+			char *end;
+			t->type = NUMBER;
+			t->insn.op = OP_IMM;
+			t->insn.arg = strtoul(s, &end, (s[0] == '0' && (s[1] == 'x' || s[1] == 'X') ? 16 : 10));
+			len = end - s;
+			if (len == 0 || isalnum((unsigned char)*end)) {
+				return error_at(e, position, "invalid number");
 			}
 		}
+		else if (*s == '$' || isalpha((unsigned char)*s) || *s == '_') {
+			const char *name = (*s == '$' ? s + 1 : s);
+			int name_len = 0;
+			while (isalnum((unsigned char)name[name_len]) || name[name_len] == '_') {
+				name_len++;
+			}
+			len = name_len + (name - s);
 
-		if(i == NR_REGEX) {
-			printf("no match at position %d\n%s\n%*.s^\n", position, e, position, "");
-			return false;
+			if (*s == '$') {
+				t->type = REGISTER;
+				if (!resolve_register(name, name_len, &t->insn)) {
+					return error_at(e, position, "unknown register");
+				}
+			}
+			else {
+				t->type = IDENT;
+				t->insn.op = OP_IMM;
+				if (!resolve_symbol(name, name_len, &t->insn.arg)) {
+					return error_at(e, position, "unknown symbol");
+				}
+			}
 		}
+		else {
+			return error_at(e, position, "no match");
+		}
+
+		nr_token++;
+		position += len;
 	}
 
 	return true;
@@ -285,107 +231,126 @@ static int find_dominant_op(int l, int r, bool *success) {
 	return op;
 }
 
-static uint32_t eval(int l, int r, bool *success) {
+static void emit(Expr *code, int op, uint32_t arg) {
+	assert(code->nr_insn < EXPR_MAX_LEN);
+	code->insn[code->nr_insn].op = op;
+	code->insn[code->nr_insn].arg = arg;
+	code->nr_insn++;
+}
+
+/* Emit the code of tokens[l..r] in postfix order. */
+static void compile(int l, int r, Expr *code, bool *success) {
 	if (!*success) {
-		return 0;
+		return;
 	}
 
 	if (l > r) {
 		*success = false;
-		return 0;
+		return;
 	}
 
 	if (l == r) {
-		if (tokens[l].type == NUMBER) {
-			// Detect base: hex if starts with 0x/0X, otherwise decimal
-			int base = 10;
-			if (strlen(tokens[l].str) >= 2 && 
-				tokens[l].str[0] == '0' && 
-				(tokens[l].str[1] == 'x' || tokens[l].str[1] == 'X')) {
-				base = 16;
-			}
-			return (uint32_t)strtoul(tokens[l].str, NULL, base);
-		} else if (tokens[l].type == REGISTER) {
-			return get_register_value(tokens[l].str, success);
-		} else if (tokens[l].type == IDENT) {
-			if (symtab == NULL || strtab == NULL) {
-				*success = false;
-				return 0;
-			}
-			int i;
-			for (i = 0; i < nr_symtab_entry; i++) {
-				if (ELF32_ST_TYPE(symtab[i].st_info) == STT_OBJECT) {
-					const char *name = strtab + symtab[i].st_name;
-					if (strcmp(name, tokens[l].str) == 0) {
-						return symtab[i].st_value;
-					}
-				}
-			}
-			*success = false;
-			return 0;
+		if (tokens[l].type == NUMBER || tokens[l].type == REGISTER || tokens[l].type == IDENT) {
+			emit(code, tokens[l].insn.op, tokens[l].insn.arg);
 		} else {
 			*success = false;
-			return 0;
 		}
+		return;
 	}
 
 	if (check_parentheses(l, r, success)) {
-		return eval(l + 1, r - 1, success);
+		compile(l + 1, r - 1, code, success);
+		return;
 	}
 
 	int op = find_dominant_op(l, r, success);
-	if (!*success) return 0;
-	
+	if (!*success) return;
+
+	static const uint8_t opcode[] = {
+		[EQ - NOTYPE] = OP_EQ, [NEQ - NOTYPE] = OP_NE, [AND - NOTYPE] = OP_AND, [OR - NOTYPE] = OP_OR,
+		[NOT - NOTYPE] = OP_NOT, [PLUS - NOTYPE] = OP_ADD, [MINUS - NOTYPE] = OP_SUB, [NEG - NOTYPE] = OP_NEG,
+		[MULTIPLY - NOTYPE] = OP_MUL, [DEREF - NOTYPE] = OP_DEREF, [DIVIDE - NOTYPE] = OP_DIV,
+	};
+
 	// Handle unary operators
-	if (tokens[op].type == NEG) {
-		uint32_t val = eval(op + 1, r, success);
-		if (!*success) return 0;
-		return -val;
-	}
-	
-	if (tokens[op].type == NOT) {
-		uint32_t val = eval(op + 1, r, success);
-		if (!*success) return 0;
-		return !val;  // logical NOT: 0 if val != 0, 1 if val == 0
+	if (tokens[op].type == NEG || tokens[op].type == NOT || tokens[op].type == DEREF) {
+		if (op != l) {
+			*success = false;
+			return;
+		}
+		compile(op + 1, r, code, success);
+		emit(code, opcode[tokens[op].type - NOTYPE], 0);
+		return;
 	}
-	
-	if (tokens[op].type == DEREF) {
-		uint32_t addr = eval(op + 1, r, success);
-		if (!*success) return 0;
-		// Dereference: read 4 bytes from memory address
-		return swaddr_read(addr, 4);
+
+	compile(l, op - 1, code, success);
+	compile(op + 1, r, code, success);
+	emit(code, opcode[tokens[op].type - NOTYPE], 0);
+}
+
+bool expr_compile(const char *e, Expr *code) {
+	code->nr_insn = 0;
+	if (!make_token(e)) {
+		return false;
 	}
-	
-	uint32_t val1 = eval(l, op - 1, success);
-	if (!*success) return 0;
-	uint32_t val2 = eval(op + 1, r, success);
-	if (!*success) return 0;
-
-	switch (tokens[op].type) {
-		case PLUS: return val1 + val2;
-		case MINUS: return val1 - val2;
-		case MULTIPLY: return val1 * val2;
-		case DIVIDE:
-			if (val2 == 0) {
-				*success = false;
-				return 0;
+
+	bool success = true;
+	compile(0, nr_token - 1, code, &success);
+	return success;
+}
+
+uint32_t expr_eval(const Expr *code, bool *success) {
+	uint32_t stack[EXPR_MAX_LEN];
+	int sp = 0;
+	int i;
+	for (i = 0; i < code->nr_insn; i++) {
+		uint32_t arg = code->insn[i].arg;
+		switch (code->insn[i].op) {
+			case OP_IMM: stack[sp++] = arg; break;
+			case OP_EIP: stack[sp++] = cpu.eip; break;
+			case OP_REG32: stack[sp++] = reg_l(arg); break;
+			case OP_REG16: stack[sp++] = reg_w(arg); break;
+			case OP_REG8: stack[sp++] = reg_b(arg); break;
+			case OP_NEG: stack[sp - 1] = -stack[sp - 1]; break;
+			case OP_NOT: stack[sp - 1] = !stack[sp - 1]; break;
+			// Dereference: read 4 bytes from memory address, unseen by the tracers
+			case OP_DEREF: stack[sp - 1] = swaddr_read_raw(stack[sp - 1], 4, R_DS); break;
+			default: {
+				uint32_t val2 = stack[--sp];
+				uint32_t val1 = stack[sp - 1];
+				uint32_t res;
+				switch (code->insn[i].op) {
+					case OP_ADD: res = val1 + val2; break;
+					case OP_SUB: res = val1 - val2; break;
+					case OP_MUL: res = val1 * val2; break;
+					case OP_DIV:
+						if (val2 == 0) {
+							*success = false;
+							return 0;
+						}
+						res = val1 / val2;
+						break;
+					case OP_EQ: res = val1 == val2; break;
+					case OP_NE: res = val1 != val2; break;
+					case OP_AND: res = val1 && val2; break;
+					case OP_OR: res = val1 || val2; break;
+					default: panic("invalid expression code %d", code->insn[i].op);
+				}
+				stack[sp - 1] = res;
 			}
-			return val1 / val2;
-		case EQ: return val1 == val2;
-		case NEQ: return val1 != val2;
-		case AND: return val1 && val2;  // logical AND: 1 if both non-zero, 0 otherwise
-		case OR: return val1 || val2;   // logical OR: 1 if either non-zero, 0 if both zero
-		default:
-			*success = false;
-			return 0;
+		}
 	}
+
+	assert(sp == 1);
+	*success = true;
+	return stack[0];
 }
 
 uint32_t expr(char *e, bool *success) {
-	if(!make_token(e)) {
+	Expr code;
+	if (!expr_compile(e, &code)) {
 		*success = false;
 		return 0;
 	}
-	*success = true;
-	return eval(0, nr_token - 1, success);
+	return expr_eval(&code, success);
 }
@@ -1,9 +1,23 @@
+/* for memmem() */
+#define _GNU_SOURCE
 #include <inttypes.h>
 
 #include "monitor/monitor.h"
 #include "monitor/elf.h"
 #include "monitor/expr.h"
 #include "monitor/watchpoint.h"
+#include "monitor/breakpoint.h"
+#include "monitor/snapshot.h"
+#include "monitor/itrace.h"
+#include "monitor/ftrace.h"
+#include "monitor/profile.h"
+#include "monitor/callgrind.h"
+#include "monitor/coverage.h"
+#include "monitor/hashtrace.h"
+#include "monitor/reverse.h"
+#include "monitor/perf.h"
+#include "memory/dirty.h"
+#include "memory/mtrace.h"
 #include "nemu.h"
 
 #include <stdlib.h>
@@ -12,6 +26,7 @@
 #include <elf.h>
 
 void cpu_exec(uint32_t);
+void init_ddr3();
 
 /* We use the `readline' library to provide more flexibility to read from stdin. */
 char* rl_gets() {
@@ -36,6 +51,23 @@ static int cmd_c(char *args) {
 	return 0;
 }
 
+static int cmd_rsi(char *args) {
+	uint32_t step = 1;
+	if (args != NULL) {
+		if (sscanf(args, "%u", &step) != 1 || step == 0) {
+			printf("Invalid number of steps: %s\n", args);
+			return 0;
+		}
+	}
+	reverse_stepi(step);
+	return 0;
+}
+
+static int cmd_rc(char *args) {
+	reverse_continue();
+	return 0;
+}
+
 static int cmd_q(char *args) {
 	return -1;
 }
@@ -55,7 +87,7 @@ static int cmd_si(char *args) {
 static int cmd_info(char *args) {
 	// print registers when args is "r"
 	if (args == NULL) {
-		printf("Usage: info r/w\n");
+		printf("Usage: info r/w/b/perf, info perf reset\n");
 		return 0;
 	}
 
@@ -80,9 +112,23 @@ static int cmd_info(char *args) {
 		printf("OF: %d\n", cpu.eflags.OF);
 		printf("IOPL: %d\n", cpu.eflags.IOPL);
 		printf("NT: %d\n", cpu.eflags.NT);
+		// Print segment registers with their cached descriptors
+		for (i = R_ES; i <= R_GS; i++) {
+			printf("%s: 0x%04x (base = 0x%08x, limit = 0x%08x)\n", sregs[i],
+				cpu.sreg[i].selector, cpu.sreg[i].base, cpu.sreg[i].limit);
+		}
+		printf("cr0: 0x%08x\n", cpu.cr0.val);
 	} else if (strcmp(args, "w") == 0) {
 		// Print watchpoints
 		print_wp();
+	} else if (strcmp(args, "b") == 0) {
+		// Print breakpoints
+		print_bp();
+	} else if (strcmp(args, "perf") == 0) {
+		perf_print(stdout);
+	} else if (strcmp(args, "perf reset") == 0) {
+		perf_reset();
+		printf("Performance counters are reset.\n");
 	} else {
 		printf("Unknown argument '%s'\n", args);
 	}
@@ -120,7 +166,7 @@ static int cmd_x(char *args) {
 
 	int i;
 	for (i = 0; i < n; i++) {
-		uint32_t data = swaddr_read(addr + i * 4, 4);
+		uint32_t data = swaddr_read_raw(addr + i * 4, 4, R_DS);
 		printf("0x%08x: 0x%08x\n", addr + i * 4, data);
 	}
 
@@ -150,10 +196,11 @@ static int cmd_w(char *args) {
 		return 0;
 	}
 	
-	// Test if expression is valid
-	bool success;
-	uint32_t value = expr(args, &success);
-	if (!success) {
+	// Compile the expression once, and test if it is valid
+	Expr code;
+	bool success = expr_compile(args, &code);
+	uint32_t value = (success ? expr_eval(&code, &success) : 0);
+	if (!success || strlen(args) >= sizeof(((WP *)0)->expr)) {
 		printf("Invalid expression: %s\n", args);
 		return 0;
 	}
@@ -166,12 +213,151 @@ static int cmd_w(char *args) {
 	
 	// Store expression and initial value
 	strcpy(wp->expr, args);
+	wp->code = code;
 	wp->old_value = value;
 	
 	printf("Hardware watchpoint %d: %s\n", wp->NO, wp->expr);
 	return 0;
 }
 
+/* watch/rwatch/awatch -l ADDR LEN watch LEN bytes of memory from ADDR,
+ * watch EXPR is the same as w EXPR.
+ */
+static int set_range_wp(char *args, int type, const char *usage) {
+	if (args == NULL) {
+		printf("Usage: %s\n", usage);
+		return 0;
+	}
+
+	if (strncmp(args, "-l ", 3) != 0) {
+		if (type == WP_WRITE) {
+			return cmd_w(args);
+		}
+		printf("Usage: %s\n", usage);
+		return 0;
+	}
+
+	/* LEN is the last word, ADDR may contain spaces */
+	char *addr_str = args + 3;
+	char *len_str = strrchr(addr_str, ' ');
+	uint32_t len;
+	if (len_str == NULL || sscanf(len_str + 1, "%u", &len) != 1 || len == 0) {
+		printf("Usage: %s\n", usage);
+		return 0;
+	}
+	*len_str = '\0';
+
+	bool success;
+	swaddr_t addr = expr(addr_str, &success);
+	if (!success) {
+		printf("Invalid expression: %s\n", addr_str);
+		return 0;
+	}
+	if (addr + len - 1 < addr) {
+		printf("The range wraps around the address space\n");
+		return 0;
+	}
+
+	WP *wp = new_range_wp(type, addr, len);
+	if (wp == NULL) {
+		return 0;
+	}
+
+	static const char *type_name[] = {
+		[WP_WRITE] = "Hardware", [WP_READ] = "Hardware read", [WP_ACCESS] = "Hardware access (read/write)"
+	};
+	printf("%s watchpoint %d: %s\n", type_name[type], wp->NO, wp->expr);
+	return 0;
+}
+
+static int cmd_watch(char *args) {
+	return set_range_wp(args, WP_WRITE, "watch -l ADDR LEN | watch EXPR");
+}
+
+static int cmd_rwatch(char *args) {
+	return set_range_wp(args, WP_READ, "rwatch -l ADDR LEN");
+}
+
+static int cmd_awatch(char *args) {
+	return set_range_wp(args, WP_ACCESS, "awatch -l ADDR LEN");
+}
+
+/* b/tbreak ADDR|SYMBOL [if EXPR] */
+static int set_bp(char *args, bool temporary) {
+	if (args == NULL) {
+		printf("Usage: %s ADDR|SYMBOL [if EXPR]\n", (temporary ? "tbreak" : "b"));
+		return 0;
+	}
+
+	char *cond = strstr(args, " if ");
+	if (cond != NULL) {
+		*cond = '\0';
+		cond += 4;
+	}
+
+	bool success;
+	swaddr_t addr = expr(args, &success);
+	if (!success) {
+		printf("Invalid location: %s\n", args);
+		return 0;
+	}
+
+	BP *bp = new_bp(addr, temporary, cond);
+	if (bp != NULL) {
+		printf("%s %d at 0x%08x\n", (temporary ? "Temporary breakpoint" : "Breakpoint"), bp->NO, addr);
+	}
+	return 0;
+}
+
+static int cmd_b(char *args) {
+	return set_bp(args, false);
+}
+
+static int cmd_tbreak(char *args) {
+	return set_bp(args, true);
+}
+
+static int cmd_ignore(char *args) {
+	int no;
+	uint32_t count;
+	if (args == NULL || sscanf(args, "%d %u", &no, &count) != 2) {
+		printf("Usage: ignore N COUNT\n");
+		return 0;
+	}
+
+	BP *bp = find_bp(no);
+	if (bp == NULL) {
+		printf("No breakpoint number %d.\n", no);
+		return 0;
+	}
+
+	bp->ignore_count = count;
+	if (count == 0) {
+		printf("Will stop next time breakpoint %d is reached.\n", no);
+	} else {
+		printf("Will ignore next %u crossings of breakpoint %d.\n", count, no);
+	}
+	return 0;
+}
+
+static int cmd_delete(char *args) {
+	if (args == NULL) {
+		printf("Usage: delete N\n");
+		return 0;
+	}
+
+	int no = atoi(args);
+	BP *bp = find_bp(no);
+	if (bp == NULL) {
+		printf("No breakpoint number %d.\n", no);
+		return 0;
+	}
+
+	free_bp(bp);
+	printf("Delete breakpoint %d.\n", no);
+	return 0;
+}
+
 static int cmd_d(char *args) {
 	if (args == NULL) {
 		printf("Usage: d N\n");
@@ -190,16 +376,494 @@ static int cmd_d(char *args) {
 	return 0;
 }
 
-static const char* find_function_name(uint32_t addr) {
-	int i;
-	for (i = 0; i < nr_symtab_entry; i++) {
-		if (ELF32_ST_TYPE(symtab[i].st_info) == STT_FUNC) {
-			uint32_t func_start = symtab[i].st_value;
-			uint32_t func_end = func_start + symtab[i].st_size;
-			if (addr >= func_start && addr < func_end) {
-				return strtab + symtab[i].st_name;
+static void print_wss(const char *prefix) {
+	printf("%s%u pages (%u KB) dirty\n", prefix, nr_dirty_page,
+		nr_dirty_page * (PMEM_PAGE_SIZE / 1024));
+}
+
+/* Report the working-set size, i.e. the number of pages written since the
+ * last report. With N given, execute the program N instructions at a time
+ * and report the pages dirtied by each interval, COUNT times or until the
+ * program stops.
+ */
+static int cmd_wss(char *args) {
+	uint32_t step = 0, count = -1;
+	if (args != NULL) {
+		if (sscanf(args, "%u %u", &step, &count) < 1 || step == 0 || count == 0) {
+			printf("Usage: wss [N [COUNT]]\n");
+			return 0;
+		}
+	}
+
+	if (step == 0) {
+		print_wss("");
+		dirty_clear();
+		return 0;
+	}
+
+	dirty_clear();
+	uint32_t i;
+	for (i = 0; i < count; i++) {
+		cpu_exec(step);
+		char prefix[32];
+		snprintf(prefix, sizeof(prefix), "[%u] ", i);
+		print_wss(prefix);
+		dirty_clear();
+		if (nemu_state != STOP) { break; }
+	}
+	return 0;
+}
+
+static int cmd_save(char *args) {
+	char *file = (args ? strtok(args, " ") : NULL);
+	if (file == NULL) {
+		printf("Usage: save FILE\n");
+		return 0;
+	}
+
+	if (save_snapshot(file)) {
+		printf("Snapshot saved to '%s'\n", file);
+	}
+	return 0;
+}
+
+static int cmd_load(char *args) {
+	char *file = (args ? strtok(args, " ") : NULL);
+	if (file == NULL) {
+		printf("Usage: load FILE\n");
+		return 0;
+	}
+
+	if (load_snapshot(file)) {
+		printf("Snapshot loaded from '%s', eip = 0x%08x\n", file, cpu.eip);
+	}
+	return 0;
+}
+
+static int cmd_mtrace(char *args) {
+	char *file = (args ? strtok(args, " ") : NULL);
+	if (file == NULL) {
+		printf("Usage: mtrace FILE [RATE] | mtrace off\n");
+		return 0;
+	}
+
+	if (strcmp(file, "off") == 0) {
+		mtrace_stop();
+		return 0;
+	}
+
+	uint32_t rate = 1000;
+	char *rate_str = strtok(NULL, " ");
+	if (rate_str != NULL && (sscanf(rate_str, "%u", &rate) != 1 || rate == 0)) {
+		printf("Invalid sampling rate: %s\n", rate_str);
+		return 0;
+	}
+
+	if (mtrace_start(file, rate)) {
+		printf("Sampling 1/%u memory accesses into '%s'\n", rate, file);
+	}
+	return 0;
+}
+
+static int cmd_itrace(char *args) {
+	char *file = (args ? strtok(args, " ") : NULL);
+	if (file == NULL) {
+		printf("Usage: itrace FILE [N] | itrace off\n");
+		return 0;
+	}
+
+	if (strcmp(file, "off") == 0) {
+		itrace_stop();
+		return 0;
+	}
+
+	uint32_t nr = ITRACE_DEFAULT_LEN;
+	char *nr_str = strtok(NULL, " ");
+	if (nr_str != NULL && (sscanf(nr_str, "%u", &nr) != 1 || nr == 0)) {
+		printf("Invalid number of instructions: %s\n", nr_str);
+		return 0;
+	}
+
+	if (itrace_start(file, nr)) {
+		printf("Tracing the last %u instructions into '%s'\n", nr, file);
+	}
+	return 0;
+}
+
+static int cmd_hashtrace(char *args) {
+	char *file = (args ? strtok(args, " ") : NULL);
+	if (file == NULL) {
+		printf("Usage: hashtrace FILE [N] | hashtrace off\n");
+		return 0;
+	}
+
+	if (strcmp(file, "off") == 0) {
+		hashtrace_stop();
+		return 0;
+	}
+
+	uint32_t nr = HASHTRACE_DEFAULT_INTERVAL;
+	char *nr_str = strtok(NULL, " ");
+	if (nr_str != NULL && (sscanf(nr_str, "%u", &nr) != 1 || nr == 0)) {
+		printf("Invalid number of instructions: %s\n", nr_str);
+		return 0;
+	}
+
+	if (hashtrace_start(file, nr)) {
+		printf("Hashing the state every %u instructions into '%s'\n", nr, file);
+	}
+	return 0;
+}
+
+/* Parse an optional `-d DEPTH' in front of the remaining arguments. */
+static bool parse_depth(char **tok, int *depth) {
+	*depth = -1;
+	if (*tok != NULL && strcmp(*tok, "-d") == 0) {
+		char *depth_str = strtok(NULL, " ");
+		if (depth_str == NULL || sscanf(depth_str, "%d", depth) != 1 || *depth < 0) {
+			return false;
+		}
+		*tok = strtok(NULL, " ");
+	}
+	return true;
+}
+
+static int cmd_ftrace(char *args) {
+	char *sub = (args ? strtok(args, " ") : NULL);
+	char *tok = strtok(NULL, " ");
+	int depth;
+	if (sub == NULL || !parse_depth(&tok, &depth)) {
+		goto usage;
+	}
+
+	if (strcmp(sub, "on") == 0) {
+		uint32_t nr = 1 << 20;
+		if (tok != NULL && (sscanf(tok, "%u", &nr) != 1 || nr == 0)) {
+			goto usage;
+		}
+		if (ftrace_start(nr, depth)) {
+			printf("Tracing the last %u calls and returns\n", nr);
+		}
+	}
+	else if (strcmp(sub, "off") == 0) { ftrace_stop(); }
+	else if (strcmp(sub, "dump") == 0) { ftrace_dump(tok, depth); }
+	else if (strcmp(sub, "stat") == 0) { ftrace_stat(tok); }
+	else { goto usage; }
+	return 0;
+
+usage:
+	printf("Usage: ftrace on [-d DEPTH] [N] | ftrace off | ftrace dump [-d DEPTH] [PATTERN] | ftrace stat [PATTERN]\n");
+	return 0;
+}
+
+static int cmd_profile(char *args) {
+	char *sub = (args ? strtok(args, " ") : NULL);
+	char *arg = strtok(NULL, " ");
+	if (sub == NULL) {
+		goto usage;
+	}
+
+	if (strcmp(sub, "on") == 0) {
+		uint32_t rate = PROFILE_DEFAULT_RATE;
+		if (arg != NULL && (sscanf(arg, "%u", &rate) != 1 || rate == 0)) {
+			goto usage;
+		}
+		profile_start(rate);
+		printf("Sampling the call stack every %u instructions\n", rate);
+	}
+	else if (strcmp(sub, "off") == 0) { profile_stop(); }
+	else if (strcmp(sub, "dump") == 0 && arg != NULL) { profile_dump(arg); }
+	else { goto usage; }
+	return 0;
+
+usage:
+	printf("Usage: profile on [N] | profile off | profile dump FILE\n");
+	return 0;
+}
+
+static int cmd_reverse(char *args) {
+	char *sub = (args ? strtok(args, " ") : NULL);
+	if (sub == NULL) {
+		goto usage;
+	}
+
+	if (strcmp(sub, "on") == 0) {
+		uint32_t interval = REVERSE_DEFAULT_INTERVAL, budget = REVERSE_DEFAULT_BUDGET;
+		char *arg = strtok(NULL, " ");
+		if (arg != NULL && (sscanf(arg, "%u", &interval) != 1 || interval == 0)) {
+			goto usage;
+		}
+		arg = strtok(NULL, " ");
+		if (arg != NULL && (sscanf(arg, "%u", &budget) != 1 || budget == 0)) {
+			goto usage;
+		}
+		reverse_start(interval, budget);
+		printf("Checkpoint every %u instructions within %u MB\n", interval, budget);
+	}
+	else if (strcmp(sub, "off") == 0) { reverse_stop(); }
+	else if (strcmp(sub, "info") == 0) { reverse_info(); }
+	else { goto usage; }
+	return 0;
+
+usage:
+	printf("Usage: reverse on [N [MB]] | reverse off | reverse info\n");
+	return 0;
+}
+
+static int cmd_callgrind(char *args) {
+	char *sub = (args ? strtok(args, " ") : NULL);
+	char *arg = strtok(NULL, " ");
+	if (sub == NULL) {
+		goto usage;
+	}
+
+	if (strcmp(sub, "on") == 0) {
+		callgrind_start();
+		printf("Counting the cost of each instruction and call\n");
+	}
+	else if (strcmp(sub, "off") == 0) { callgrind_stop(); }
+	else if (strcmp(sub, "dump") == 0 && arg != NULL) { callgrind_dump(arg); }
+	else { goto usage; }
+	return 0;
+
+usage:
+	printf("Usage: callgrind on | callgrind off | callgrind dump FILE\n");
+	return 0;
+}
+
+static int cmd_coverage(char *args) {
+	char *sub = (args ? strtok(args, " ") : NULL);
+	char *arg = strtok(NULL, " ");
+	if (sub == NULL) {
+		goto usage;
+	}
+
+	if (strcmp(sub, "on") == 0) {
+		coverage_start();
+		printf("Marking the basic blocks executed\n");
+	}
+	else if (strcmp(sub, "off") == 0) { coverage_stop(); }
+	else if (strcmp(sub, "dump") == 0 && arg != NULL) { coverage_dump(arg); }
+	else { goto usage; }
+	return 0;
+
+usage:
+	printf("Usage: coverage on | coverage off | coverage dump FILE\n");
+	return 0;
+}
+
+#define PATTERN_MAX 256
+
+/* Parse the pattern of `find'. Numbers are stored with `size' bytes,
+ * and strings in double quotes without the terminating '\0'.
+ */
+static int parse_pattern(char *s, int size, uint8_t *pat) {
+	int len = 0;
+	while (1) {
+		while (*s == ' ') { s++; }
+		if (*s == '\0') { break; }
+
+		if (*s == '"') {
+			for (s++; *s != '"'; s++) {
+				if (*s == '\0' || len == PATTERN_MAX) { return -1; }
+				if (*s == '\\') {
+					s++;
+					switch (*s) {
+						case 'n': pat[len++] = '\n'; break;
+						case 't': pat[len++] = '\t'; break;
+						case '0': pat[len++] = '\0'; break;
+						case '\\': case '"': pat[len++] = *s; break;
+						default: return -1;
+					}
+				} else {
+					pat[len++] = *s;
+				}
 			}
+			s++;
+			continue;
+		}
+
+		char *end = strchr(s, ' ');
+		if (end != NULL) { *end = '\0'; }
+		bool success;
+		uint32_t val = expr(s, &success);
+		if (!success || len + size > PATTERN_MAX) { return -1; }
+		memcpy(pat + len, &val, size);
+		len += size;
+		if (end == NULL) { break; }
+		s = end + 1;
+	}
+	return len;
+}
+
+static int cmd_find(char *args) {
+	const char *usage = "Usage: find [/b|/h|/w] START END PATTERN...";
+	int size = 4;
+	char *start_str = (args ? strtok(args, " ") : NULL);
+	if (start_str != NULL && start_str[0] == '/') {
+		switch (start_str[1]) {
+			case 'b': size = 1; break;
+			case 'h': size = 2; break;
+			case 'w': size = 4; break;
+			default: printf("%s\n", usage); return 0;
+		}
+		start_str = strtok(NULL, " ");
+	}
+	char *end_str = strtok(NULL, " ");
+	char *pat_str = strtok(NULL, "");
+	if (start_str == NULL || end_str == NULL || pat_str == NULL) {
+		printf("%s\n", usage);
+		return 0;
+	}
+
+	bool success1, success2;
+	swaddr_t start = expr(start_str, &success1);
+	swaddr_t end = expr(end_str, &success2);
+	if (!success1 || !success2 || start >= end) {
+		printf("Invalid range: %s %s\n", start_str, end_str);
+		return 0;
+	}
+
+	uint8_t pat[PATTERN_MAX];
+	int pat_len = parse_pattern(pat_str, size, pat);
+	if (pat_len <= 0) {
+		printf("Invalid pattern: %s\n", pat_str);
+		return 0;
+	}
+
+	/* Search each piece of RAM in the range directly in host memory. */
+	lnaddr_t lstart = swaddr_translate(start, end - start, R_DS);
+	uint64_t cur = lstart, lend = (uint64_t)lstart + (end - start);
+	int nr_found = 0;
+	while (cur < lend) {
+		size_t len = lend - cur;
+		uint8_t *p = pmem_host_ptr(cur, &len);
+		if (p == NULL) {
+			cur = (cur & ~(uint64_t)(PMEM_PAGE_SIZE - 1)) + PMEM_PAGE_SIZE;
+			continue;
+		}
+
+		uint8_t *q = p;
+		while (q < p + len) {
+			q = (pat_len == 1 ? memchr(q, pat[0], p + len - q) : memmem(q, p + len - q, pat, pat_len));
+			if (q == NULL) { break; }
+			printf("0x%08x\n", (uint32_t)(start + (cur - lstart) + (q - p)));
+			nr_found++;
+			q++;
+		}
+		cur += len;
+	}
+
+	if (nr_found == 0) {
+		printf("Pattern not found.\n");
+	} else {
+		printf("%d pattern%s found.\n", nr_found, (nr_found > 1 ? "s" : ""));
+	}
+	return 0;
+}
+
+static int cmd_dump(char *args) {
+	char *start_str = (args ? strtok(args, " ") : NULL);
+	char *len_str = strtok(NULL, " ");
+	char *file = strtok(NULL, " ");
+	if (start_str == NULL || len_str == NULL || file == NULL) {
+		printf("Usage: dump START LEN FILE\n");
+		return 0;
+	}
+
+	bool success1, success2;
+	swaddr_t start = expr(start_str, &success1);
+	uint32_t len = expr(len_str, &success2);
+	if (!success1 || !success2 || len == 0 || start + len - 1 < start) {
+		printf("Invalid range: %s %s\n", start_str, len_str);
+		return 0;
+	}
+
+	FILE *fp = fopen(file, "wb");
+	if (fp == NULL) {
+		printf("Can not open '%s'\n", file);
+		return 0;
+	}
+
+	lnaddr_t lstart = swaddr_translate(start, len, R_DS);
+	uint32_t done = 0;
+	while (done < len) {
+		size_t n = len - done;
+		uint8_t *p = pmem_host_ptr(lstart + done, &n);
+		if (p == NULL) {
+			printf("0x%08x is not backed by RAM\n", start + done);
+			break;
+		}
+		if (fwrite(p, n, 1, fp) != 1) {
+			printf("Can not write '%s'\n", file);
+			break;
+		}
+		done += n;
+	}
+
+	fclose(fp);
+	printf("%u bytes dumped to '%s'\n", done, file);
+	return 0;
+}
+
+static int cmd_restore(char *args) {
+	char *file = (args ? strtok(args, " ") : NULL);
+	char *addr_str = strtok(NULL, "");
+	if (file == NULL || addr_str == NULL) {
+		printf("Usage: restore FILE ADDR\n");
+		return 0;
+	}
+
+	bool success;
+	swaddr_t start = expr(addr_str, &success);
+	if (!success) {
+		printf("Invalid expression: %s\n", addr_str);
+		return 0;
+	}
+
+	FILE *fp = fopen(file, "rb");
+	if (fp == NULL) {
+		printf("Can not open '%s'\n", file);
+		return 0;
+	}
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	rewind(fp);
+	if (size <= 0 || size - 1 > UINT32_MAX || start + (uint32_t)(size - 1) < start) {
+		printf("'%s' is empty or too large\n", file);
+		fclose(fp);
+		return 0;
+	}
+
+	lnaddr_t lstart = swaddr_translate(start, size, R_DS);
+	uint32_t done = 0;
+	while (done < size) {
+		size_t n = size - done;
+		uint8_t *p = pmem_host_ptr(lstart + done, &n);
+		if (p == NULL) {
+			printf("0x%08x is not backed by RAM\n", start + done);
+			break;
+		}
+		if (fread(p, n, 1, fp) != 1) {
+			printf("Can not read '%s'\n", file);
+			break;
 		}
+		done += n;
+	}
+	fclose(fp);
+
+	/* Memory is written behind the back of DRAM. */
+	dirty_mark_range(lstart, done);
+	init_ddr3();
+	reverse_reset();
+	printf("%u bytes restored to 0x%08x\n", done, start);
+	return 0;
+}
+
+static const char* find_function_name(uint32_t addr) {
+	const Elf32_Sym *sym = find_symbol(addr, STT_FUNC);
+	if (sym != NULL) {
+		return strtab + sym->st_name;
 	}
 	return "??";  // Unknown function
 }
@@ -216,11 +880,11 @@ static int cmd_bt(char *args) {
 
 	// Collect frames
 	while (current_ebp != 0 && cnt < max_frames) {
-		uint32_t ret_addr = swaddr_read(current_ebp + 4, 4);
-		uint32_t a0 = swaddr_read(current_ebp + 8, 4);
-		uint32_t a1 = swaddr_read(current_ebp + 12, 4);
-		uint32_t a2 = swaddr_read(current_ebp + 16, 4);
-		uint32_t a3 = swaddr_read(current_ebp + 20, 4);
+		uint32_t ret_addr = swaddr_read_raw(current_ebp + 4, 4, R_SS);
+		uint32_t a0 = swaddr_read_raw(current_ebp + 8, 4, R_SS);
+		uint32_t a1 = swaddr_read_raw(current_ebp + 12, 4, R_SS);
+		uint32_t a2 = swaddr_read_raw(current_ebp + 16, 4, R_SS);
+		uint32_t a3 = swaddr_read_raw(current_ebp + 20, 4, R_SS);
 
 		ebp_arr[cnt] = current_ebp;
 		ret_arr[cnt] = ret_addr;
@@ -230,7 +894,7 @@ static int cmd_bt(char *args) {
 		args_arr[cnt][3] = a3;
 
 		// move to previous frame
-		current_ebp = swaddr_read(current_ebp, 4);
+		current_ebp = swaddr_read_raw(current_ebp, 4, R_SS);
 		cnt++;
 	}
 
@@ -273,12 +937,35 @@ static struct {
 	{ "c", "Continue the execution of the program", cmd_c },
 	{ "q", "Exit NEMU", cmd_q },
 	{ "si", "Step N instructions", cmd_si },
-	{ "info", "Print the register/watchpoint state", cmd_info },
+	{ "rsi", "Step N instructions backwards", cmd_rsi },
+	{ "rc", "Continue backwards to the last breakpoint or watchpoint hit", cmd_rc },
+	{ "reverse", "Take checkpoints every N instructions for reverse execution", cmd_reverse },
+	{ "info", "Print the register/watchpoint/breakpoint state", cmd_info },
 	{ "x", "Scan memory", cmd_x },
 	{ "p", "Evaluate expression", cmd_p },
 	{ "w", "Set watchpoint", cmd_w },
+	{ "watch", "Set watchpoint on writes to memory (-l ADDR LEN)", cmd_watch },
+	{ "rwatch", "Set watchpoint on reads from memory (-l ADDR LEN)", cmd_rwatch },
+	{ "awatch", "Set watchpoint on accesses to memory (-l ADDR LEN)", cmd_awatch },
 	{ "d", "Delete watchpoint", cmd_d },
+	{ "b", "Set breakpoint at ADDR or SYMBOL, optionally with a condition", cmd_b },
+	{ "tbreak", "Set a temporary breakpoint, deleted when hit", cmd_tbreak },
+	{ "ignore", "Ignore the next COUNT crossings of breakpoint N", cmd_ignore },
+	{ "delete", "Delete breakpoint", cmd_delete },
 	{ "bt", "Print backtrace of all stack frames", cmd_bt },
+	{ "wss", "Report the working-set size (pages written)", cmd_wss },
+	{ "save", "Save the machine state to a snapshot file", cmd_save },
+	{ "load", "Restore the machine state from a snapshot file", cmd_load },
+	{ "mtrace", "Sample memory accesses into a trace file", cmd_mtrace },
+	{ "itrace", "Trace the last N instructions into a file", cmd_itrace },
+	{ "hashtrace", "Hash the state every N instructions into a file, for nemu-diff", cmd_hashtrace },
+	{ "ftrace", "Trace function calls and count their instructions", cmd_ftrace },
+	{ "profile", "Sample the call stack into folded stacks", cmd_profile },
+	{ "callgrind", "Count the exact cost of each instruction and call in the format of callgrind", cmd_callgrind },
+	{ "coverage", "Mark the basic blocks executed, for lcov data made by nemu-cov", cmd_coverage },
+	{ "find", "Search memory in [START, END) for a sequence of values or strings", cmd_find },
+	{ "dump", "Write LEN bytes of memory from START to a file", cmd_dump },
+	{ "restore", "Load the content of a file into memory at ADDR", cmd_restore },
 
 	/* TODO: Add more commands */
 
@@ -1,30 +1,149 @@
 #include "monitor/watchpoint.h"
 #include "monitor/expr.h"
+#include "monitor/snapshot.h"
+#include "monitor/monitor.h"
 #include "nemu.h"
 
+#include <stdlib.h>
+
+/* The pool grows by this many watchpoints when it runs out. */
 #define NR_WP 32
 
-static WP wp_pool[NR_WP];
+/* all the watchpoints ever allocated, indexed by their numbers */
+static WP **wp_pool;
+static int nr_wp = 0;
 static WP *head, *free_;
 
-void init_wp_pool() {
+uint64_t wp_page_bitmap[NR_WP_PAGE_WORD];
+WP *hit_wp = NULL;
+
+/* Range watchpoints sorted by the start address, and for each of them the
+ * largest last byte among it and the ones before, so that the search for
+ * the ranges overlapping an access can stop early.
+ */
+static WP **ranges;
+static swaddr_t *max_last;
+static int nr_range = 0, range_cap = 0;
+
+static void grow_pool() {
+	WP *pool = malloc(NR_WP * sizeof(WP));
+	wp_pool = realloc(wp_pool, (nr_wp + NR_WP) * sizeof(WP *));
+	assert(pool && wp_pool);
+
 	int i;
 	for(i = 0; i < NR_WP; i ++) {
-		wp_pool[i].NO = i;
-		wp_pool[i].next = &wp_pool[i + 1];
+		pool[i].NO = nr_wp + i;
+		pool[i].next = (i == NR_WP - 1 ? free_ : &pool[i + 1]);
+		wp_pool[nr_wp + i] = &pool[i];
 	}
-	wp_pool[NR_WP - 1].next = NULL;
+	free_ = pool;
+	nr_wp += NR_WP;
+}
 
+void init_wp_pool() {
 	head = NULL;
-	free_ = wp_pool;
+	free_ = NULL;
+	grow_pool();
+	nr_range = 0;
+	memset(wp_page_bitmap, 0, sizeof(wp_page_bitmap));
+}
+
+static inline swaddr_t wp_last(WP *wp) {
+	return wp->addr + wp->len - 1;
+}
+
+static void mark_pages(WP *wp) {
+	uint32_t page = (wp->addr < 3 ? 0 : wp->addr - 3) >> 12;
+	uint32_t last = wp_last(wp) >> 12;
+	for(; page <= last; page ++) {
+		wp_page_bitmap[page >> 6] |= 1ull << (page & 63);
+	}
+}
+
+/* Rebuild the sorted ranges and the page bitmap from the active list. */
+static void index_ranges() {
+	memset(wp_page_bitmap, 0, sizeof(wp_page_bitmap));
+	nr_range = 0;
+
+	WP *wp;
+	for(wp = head; wp; wp = wp->next) {
+		if(wp->type == WP_EXPR) { continue; }
+
+		if(nr_range == range_cap) {
+			range_cap = (range_cap ? range_cap * 2 : NR_WP);
+			ranges = realloc(ranges, range_cap * sizeof(WP *));
+			max_last = realloc(max_last, range_cap * sizeof(swaddr_t));
+			assert(ranges && max_last);
+		}
+
+		int i = nr_range ++;
+		while(i > 0 && ranges[i - 1]->addr > wp->addr) {
+			ranges[i] = ranges[i - 1];
+			i --;
+		}
+		ranges[i] = wp;
+		mark_pages(wp);
+	}
+
+	int i;
+	for(i = 0; i < nr_range; i ++) {
+		swaddr_t last = wp_last(ranges[i]);
+		max_last[i] = (i > 0 && max_last[i - 1] > last ? max_last[i - 1] : last);
+	}
+}
+
+/* Called from swaddr_read() and swaddr_write() when the page is marked.
+ * The hit is reported after the instruction finishes.
+ */
+void wp_check_access(swaddr_t addr, size_t len, uint8_t sreg, bool is_write) {
+	if(nemu_state != RUNNING || (sreg == R_CS && !is_write)) {
+		/* accesses by the monitor, or instruction fetches */
+		return;
+	}
+
+	/* Bounds are inclusive, so that nothing overflows at the top of the
+	 * address space. */
+	swaddr_t last = addr + len - 1;
+	if(last < addr) { last = 0xffffffff; }
+
+	/* the ranges starting at or before the last byte */
+	int lo = 0, hi = nr_range;
+	while(lo < hi) {
+		int mid = (lo + hi) / 2;
+		if(ranges[mid]->addr <= last) { lo = mid + 1; }
+		else { hi = mid; }
+	}
+
+	int i;
+	for(i = lo - 1; i >= 0 && max_last[i] >= addr; i --) {
+		WP *wp = ranges[i];
+		if(wp_last(wp) < addr) { continue; }
+		if(wp->type == (is_write ? WP_READ : WP_WRITE)) { continue; }
+
+		wp->hit = true;
+		wp->hit_write = is_write;
+		wp->hit_addr = addr;
+	}
+}
+
+/* The value of a range, if it fits in a register and is mapped. */
+static bool range_value(WP *wp, uint32_t *value) {
+	if(wp->len != 1 && wp->len != 2 && wp->len != 4) {
+		return false;
+	}
+	if(pmem_map[wp->addr >> PMEM_PAGE_SHIFT] == PMEM_UNMAPPED ||
+			pmem_map[wp_last(wp) >> PMEM_PAGE_SHIFT] == PMEM_UNMAPPED) {
+		return false;
+	}
+	*value = swaddr_read_raw(wp->addr, wp->len, R_DS);
+	return true;
 }
 
 /* TODO: Implement the functionality of watchpoint */
 
 WP* new_wp() {
 	if (free_ == NULL) {
-		printf("No free watchpoint available\n");
-		return NULL;
+		grow_pool();
 	}
 	
 	WP *wp = free_;
@@ -32,7 +151,25 @@ WP* new_wp() {
 	
 	wp->next = head;
 	head = wp;
-	
+
+	wp->type = WP_EXPR;
+	wp->hit = false;
+	return wp;
+}
+
+WP* new_range_wp(int type, swaddr_t addr, uint32_t len) {
+	assert(type != WP_EXPR && len > 0 && addr + len - 1 >= addr);
+	WP *wp = new_wp();
+	if (wp == NULL) {
+		return NULL;
+	}
+
+	wp->type = type;
+	wp->addr = addr;
+	wp->len = len;
+	snprintf(wp->expr, sizeof(wp->expr), "-l 0x%08x %u", addr, len);
+	range_value(wp, &wp->old_value);
+	index_ranges();
 	return wp;
 }
 
@@ -53,6 +190,13 @@ void free_wp(WP *wp) {
 	// Add to free list
 	wp->next = free_;
 	free_ = wp;
+	if (hit_wp == wp) {
+		hit_wp = NULL;
+	}
+
+	if (wp->type != WP_EXPR) {
+		index_ranges();
+	}
 }
 
 WP* find_wp(int no) {
@@ -66,6 +210,16 @@ WP* find_wp(int no) {
 	return NULL;
 }
 
+WP* find_range_wp(int type, swaddr_t addr, uint32_t len) {
+	WP *wp;
+	for (wp = head; wp; wp = wp->next) {
+		if (wp->type == type && wp->addr == addr && wp->len == len) {
+			return wp;
+		}
+	}
+	return NULL;
+}
+
 void print_wp() {
 	WP *wp = head;
 	if (!wp) {
@@ -73,21 +227,62 @@ void print_wp() {
 		return;
 	}
 	
-	printf("Num     Type           Disp Enb Address    What\n");
+	static const char *type_name[] = {
+		[WP_EXPR] = "hw watchpoint", [WP_WRITE] = "hw watchpoint",
+		[WP_READ] = "read watchpoint", [WP_ACCESS] = "acc watchpoint"
+	};
+
+	printf("Num     Type            Disp Enb Address    What\n");
 	while (wp) {
-		printf("%-8d%-15s%-5s%-4s%-11s%s\n", 
-			wp->NO, "hw watchpoint", "keep", "y", "           ", wp->expr);
+		char addr[16] = "";
+		if (wp->type != WP_EXPR) {
+			snprintf(addr, sizeof(addr), "0x%08x", wp->addr);
+		}
+		printf("%-8d%-16s%-5s%-4s%-11s%s\n", 
+			wp->NO, type_name[wp->type], "keep", "y", addr, wp->expr);
 		wp = wp->next;
 	}
 }
 
+static void report_range_wp(WP *wp) {
+	uint32_t new_value = 0;
+	bool has_value = range_value(wp, &new_value);
+	wp->hit = false;
+	hit_wp = wp;
+
+	if (wp->type == WP_READ || (wp->type == WP_ACCESS && !wp->hit_write)) {
+		printf("%s watchpoint %d: %s\n", (wp->type == WP_READ ? "Read" : "Access"), wp->NO, wp->expr);
+		if (has_value) {
+			printf("Value = 0x%08x\n", new_value);
+		}
+	}
+	else {
+		printf("%s watchpoint %d: %s\n", (wp->type == WP_WRITE ? "Hardware" : "Access"), wp->NO, wp->expr);
+		if (has_value) {
+			printf("Old value = 0x%08x\n", wp->old_value);
+			printf("New value = 0x%08x\n", new_value);
+			wp->old_value = new_value;
+		}
+	}
+	printf("Hint watchpoint %d at address 0x%08x, accessing 0x%08x\n", wp->NO, cpu.eip, wp->hit_addr);
+}
+
 bool check_watchpoints() {
 	WP *wp = head;
 	bool hit = false;
 	
 	while (wp) {
+		if (wp->type != WP_EXPR) {
+			if (wp->hit) {
+				report_range_wp(wp);
+				hit = true;
+			}
+			wp = wp->next;
+			continue;
+		}
+
 		bool success = true;
-		uint32_t new_value = expr(wp->expr, &success);
+		uint32_t new_value = expr_eval(&wp->code, &success);
 		
 		if (success && new_value != wp->old_value) {
 			printf("Hardware watchpoint %d: %s\n", wp->NO, wp->expr);
@@ -103,3 +298,165 @@ bool check_watchpoints() {
 	
 	return hit;
 }
+
+/* The same as check_watchpoints(), but nothing is printed. Used when the
+ * program is replayed for reverse execution.
+ */
+bool test_watchpoints() {
+	bool hit = false;
+	WP *wp;
+	for (wp = head; wp; wp = wp->next) {
+		if (wp->type != WP_EXPR) {
+			if (wp->hit) {
+				wp->hit = false;
+				range_value(wp, &wp->old_value);
+				hit = true;
+			}
+			continue;
+		}
+
+		bool success = true;
+		uint32_t new_value = expr_eval(&wp->code, &success);
+		if (success && new_value != wp->old_value) {
+			wp->old_value = new_value;
+			hit = true;
+		}
+	}
+	return hit;
+}
+
+/* Take the current values as the old ones, after the machine state is
+ * changed behind the watchpoints.
+ */
+void sync_watchpoints() {
+	WP *wp;
+	for (wp = head; wp; wp = wp->next) {
+		wp->hit = false;
+		if (wp->type != WP_EXPR) {
+			range_value(wp, &wp->old_value);
+			continue;
+		}
+
+		bool success = true;
+		uint32_t value = expr_eval(&wp->code, &success);
+		if (success) {
+			wp->old_value = value;
+		}
+	}
+}
+
+/* Save the active watchpoints in the order of the list. */
+bool save_wp() {
+	uint32_t n = 0;
+	WP *wp;
+	for (wp = head; wp; wp = wp->next) {
+		n++;
+	}
+	if (!snapshot_write(&n, sizeof(n))) {
+		return false;
+	}
+
+	for (wp = head; wp; wp = wp->next) {
+		if (!snapshot_write(&wp->NO, sizeof(wp->NO)) ||
+				!snapshot_write(&wp->type, sizeof(wp->type)) ||
+				!snapshot_write(&wp->addr, sizeof(wp->addr)) ||
+				!snapshot_write(&wp->len, sizeof(wp->len)) ||
+				!snapshot_write(wp->expr, sizeof(wp->expr)) ||
+				!snapshot_write(&wp->old_value, sizeof(wp->old_value))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/* Read the saved watchpoints into `*saved', an array of `*n' which the
+ * caller should pass to restore_wp() or free(). Nothing is changed here,
+ * so that a bad snapshot leaves the watchpoints alone.
+ */
+bool load_wp(WP **saved, uint32_t *n) {
+	*saved = NULL;
+	if (!snapshot_read(n, sizeof(*n))) {
+		return false;
+	}
+
+	WP *wps = NULL;
+	uint32_t i, j;
+	for (i = 0; i < *n; i++) {
+		if ((i & (NR_WP - 1)) == 0) {
+			wps = realloc(wps, (i + NR_WP) * sizeof(WP));
+			assert(wps);
+		}
+
+		WP *wp = &wps[i];
+		if (!snapshot_read(&wp->NO, sizeof(wp->NO)) || wp->NO < 0 ||
+				!snapshot_read(&wp->type, sizeof(wp->type)) || wp->type < WP_EXPR || wp->type > WP_ACCESS ||
+				!snapshot_read(&wp->addr, sizeof(wp->addr)) ||
+				!snapshot_read(&wp->len, sizeof(wp->len)) ||
+				(wp->type != WP_EXPR && (wp->len == 0 || wp_last(wp) < wp->addr)) ||
+				!snapshot_read(wp->expr, sizeof(wp->expr)) ||
+				!snapshot_read(&wp->old_value, sizeof(wp->old_value))) {
+			free(wps);
+			return false;
+		}
+		wp->expr[sizeof(wp->expr) - 1] = '\0';
+		if (wp->type == WP_EXPR && !expr_compile(wp->expr, &wp->code)) {
+			free(wps);
+			return false;
+		}
+		wp->hit = false;
+
+		for (j = 0; j < i; j++) {
+			if (wps[j].NO == wp->NO) {
+				free(wps);
+				return false;
+			}
+		}
+	}
+
+	*saved = wps;
+	return true;
+}
+
+/* Replace the active watchpoints with the ones read by load_wp(), keeping
+ * their numbers and order, and free `saved'.
+ */
+void restore_wp(WP *saved, uint32_t n) {
+	uint32_t i;
+	for (i = 0; i < n; i++) {
+		while (saved[i].NO >= nr_wp) {
+			grow_pool();
+		}
+	}
+
+	bool *used = calloc(nr_wp, sizeof(bool));
+	assert(used);
+	WP *tail = NULL;
+	head = NULL;
+	hit_wp = NULL;
+	for (i = 0; i < n; i++) {
+		WP *wp = wp_pool[saved[i].NO];
+		*wp = saved[i];
+		used[wp->NO] = true;
+
+		wp->next = NULL;
+		if (tail) {
+			tail->next = wp;
+		} else {
+			head = wp;
+		}
+		tail = wp;
+	}
+
+	int no;
+	free_ = NULL;
+	for (no = nr_wp - 1; no >= 0; no--) {
+		if (!used[no]) {
+			wp_pool[no]->next = free_;
+			free_ = wp_pool[no];
+		}
+	}
+	free(used);
+	free(saved);
+
+	index_ranges();
+}
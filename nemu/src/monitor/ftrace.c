@@ -0,0 +1,219 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/ftrace.h"
+#include "monitor/elf.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <fnmatch.h>
+
+#define FTRACE_MAX_DEPTH 1024
+
+bool ftrace_on = false;
+
+/* the calls and returns, kept in a ring */
+static FTraceRecord *buf = NULL;
+static uint32_t buf_len;
+static uint64_t nr_record;
+/* deeper calls are not recorded, but still counted, -1 for no limit */
+static int record_depth;
+
+/* the shadow call stack, a frame is matched by its return address */
+typedef struct {
+	swaddr_t func;
+	swaddr_t ret_addr;
+	uint64_t start;
+	bool outermost;
+} Frame;
+
+static Frame stack[FTRACE_MAX_DEPTH];
+static int depth;
+
+/* The statistics of each function, in a hash table keyed by its address.
+ * The time of recursive calls is only counted for the outermost one.
+ */
+typedef struct {
+	swaddr_t func;
+	uint32_t active;
+	uint64_t calls;
+	uint64_t instr;
+} FuncStat;
+
+static FuncStat *stats = NULL;
+static uint32_t stat_size, nr_stat;
+
+static FuncStat *stat_slot(FuncStat *table, uint32_t size, swaddr_t func) {
+	uint32_t i = (func * 0x9e3779b1u) & (size - 1);
+	while(table[i].calls > 0 && table[i].func != func) {
+		i = (i + 1) & (size - 1);
+	}
+	return &table[i];
+}
+
+/* Return the statistics of `func', which is created by its first call. */
+static FuncStat *stat_of(swaddr_t func) {
+	FuncStat *f = stat_slot(stats, stat_size, func);
+	if(f->calls > 0) { return f; }
+
+	if((nr_stat + 1) * 2 > stat_size) {
+		FuncStat *old = stats;
+		uint32_t old_size = stat_size, i;
+		stat_size *= 2;
+		stats = calloc(stat_size, sizeof(FuncStat));
+		assert(stats);
+		for(i = 0; i < old_size; i ++) {
+			if(old[i].calls > 0) { *stat_slot(stats, stat_size, old[i].func) = old[i]; }
+		}
+		free(old);
+		f = stat_slot(stats, stat_size, func);
+	}
+	nr_stat ++;
+	f->func = func;
+	return f;
+}
+
+static void record(int type, swaddr_t func, swaddr_t site, int d) {
+	if(record_depth >= 0 && d > record_depth) { return; }
+	buf[nr_record % buf_len] = (FTraceRecord) { type, d, func, site, instr_count };
+	nr_record ++;
+}
+
+void ftrace_call_record(swaddr_t callee, swaddr_t site, swaddr_t ret_addr) {
+	FuncStat *f = stat_of(callee);
+	f->calls ++;
+	if(depth == FTRACE_MAX_DEPTH) { return; }
+
+	record(FTRACE_CALL, callee, site, depth);
+	stack[depth ++] = (Frame) { callee, ret_addr, instr_count, f->active ++ == 0 };
+}
+
+void ftrace_ret_record(swaddr_t ret_addr) {
+	int i;
+	for(i = depth - 1; i >= 0 && stack[i].ret_addr != ret_addr; i --);
+	if(i < 0) {
+		/* not the return of a traced call */
+		return;
+	}
+
+	/* The frames above are left without return, by longjmp() for example. */
+	while(depth > i) {
+		Frame *fr = &stack[-- depth];
+		FuncStat *f = stat_of(fr->func);
+		f->active --;
+		if(fr->outermost) { f->instr += instr_count - fr->start; }
+		record(FTRACE_RET, fr->func, fr->ret_addr, depth);
+	}
+}
+
+/* Keep the last `nr' calls and returns not deeper than `max_depth'. */
+bool ftrace_start(uint32_t nr, int max_depth) {
+	assert(nr > 0);
+	free(buf);
+	buf = malloc(nr * sizeof(FTraceRecord));
+	if(buf == NULL) {
+		printf("Can not allocate %u records\n", nr);
+		return false;
+	}
+	buf_len = nr;
+	nr_record = 0;
+	record_depth = max_depth;
+	depth = 0;
+
+	free(stats);
+	stat_size = 1024;
+	nr_stat = 0;
+	stats = calloc(stat_size, sizeof(FuncStat));
+	assert(stats);
+
+	ftrace_on = true;
+	return true;
+}
+
+void ftrace_stop() {
+	ftrace_on = false;
+}
+
+/* Symbols are only looked up when the trace is printed. */
+static const char *func_name(swaddr_t addr, char *name, size_t size) {
+	const Elf32_Sym *sym = find_symbol(addr, STT_FUNC);
+	if(sym == NULL) {
+		snprintf(name, size, "0x%08x", addr);
+	}
+	else if(sym->st_value == addr) {
+		snprintf(name, size, "%s", strtab + sym->st_name);
+	}
+	else {
+		snprintf(name, size, "%s+0x%x", strtab + sym->st_name, addr - sym->st_value);
+	}
+	return name;
+}
+
+/* Print the records of functions matching `pattern' (NULL for all),
+ * not deeper than `max_depth' (-1 for no limit).
+ */
+void ftrace_dump(const char *pattern, int max_depth) {
+	if(buf == NULL) {
+		printf("No function trace.\n");
+		return;
+	}
+
+	uint64_t i = (nr_record > buf_len ? nr_record - buf_len : 0);
+	if(i > 0) {
+		printf("(the first %" PRIu64 " records are overwritten)\n", i);
+	}
+	for(; i < nr_record; i ++) {
+		FTraceRecord *r = &buf[i % buf_len];
+		if(max_depth >= 0 && r->depth > max_depth) { continue; }
+
+		char name[128], site[128];
+		func_name(r->func, name, sizeof(name));
+		if(pattern && fnmatch(pattern, name, 0) != 0) { continue; }
+
+		func_name(r->site, site, sizeof(site));
+		printf("%12" PRIu64 " %*s%s %s %s %s\n", r->instr, r->depth * 2, "",
+				(r->type == FTRACE_CALL ? "call" : "ret "), name, (r->type == FTRACE_CALL ? "from" : "to"), site);
+	}
+}
+
+static int cmp_stat(const void *a, const void *b) {
+	const FuncStat *x = *(FuncStat **)a, *y = *(FuncStat **)b;
+	return (x->instr < y->instr) - (x->instr > y->instr);
+}
+
+/* Print the number of calls and the inclusive number of instructions of
+ * the functions matching `pattern' (NULL for all). The functions still
+ * running are counted to the current instruction.
+ */
+void ftrace_stat(const char *pattern) {
+	if(stats == NULL) {
+		printf("No function trace.\n");
+		return;
+	}
+
+	int i;
+	for(i = 0; i < depth; i ++) {
+		if(stack[i].outermost) { stat_of(stack[i].func)->instr += instr_count - stack[i].start; }
+	}
+
+	FuncStat **sorted = malloc(nr_stat * sizeof(FuncStat *));
+	assert(sorted);
+	uint32_t j, n = 0;
+	for(j = 0; j < stat_size; j ++) {
+		if(stats[j].calls > 0) { sorted[n ++] = &stats[j]; }
+	}
+	qsort(sorted, n, sizeof(FuncStat *), cmp_stat);
+
+	printf("%-32s %10s %16s %12s\n", "function", "calls", "inclusive insns", "per call");
+	for(j = 0; j < n; j ++) {
+		char name[128];
+		func_name(sorted[j]->func, name, sizeof(name));
+		if(pattern && fnmatch(pattern, name, 0) != 0) { continue; }
+		printf("%-32s %10" PRIu64 " %16" PRIu64 " %12" PRIu64 "\n", name, sorted[j]->calls,
+				sorted[j]->instr, sorted[j]->instr / sorted[j]->calls);
+	}
+	free(sorted);
+
+	for(i = 0; i < depth; i ++) {
+		if(stack[i].outermost) { stat_of(stack[i].func)->instr -= instr_count - stack[i].start; }
+	}
+}
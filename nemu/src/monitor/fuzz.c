@@ -0,0 +1,152 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/fuzz.h"
+
+#include <stdlib.h>
+#include <signal.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/shm.h>
+#include <sys/time.h>
+#include <sys/wait.h>
+
+/* the AFL fork server protocol */
+#define FORKSRV_FD 198
+#define SHM_ENV_VAR "__AFL_SHM_ID"
+
+/* the exit status of a run which does not finish in time */
+#define FUZZ_EXIT_TIMEOUT 2
+
+#define FUZZ_INPUT_MAX (1 << 20)
+
+void cpu_exec(uint32_t);
+
+uint8_t *fuzz_area = NULL;
+bool fuzz_branch = false;
+
+static bool fuzzing = false;
+static uint8_t *shm_area = NULL;
+static const char *input_file = NULL;
+static uint32_t timeout_ms = 0;
+static uint32_t prev_loc = 0;
+
+/* AFL-style edge coverage, the edge is identified by the previous and
+ * the current branch target.
+ */
+void fuzz_edge(swaddr_t target) {
+	uint32_t cur_loc = (target * 0x9e3779b1u) >> (32 - FUZZ_MAP_SIZE_POW2);
+	fuzz_area[cur_loc ^ prev_loc] ++;
+	prev_loc = cur_loc >> 1;
+}
+
+/* The coverage map is shared with AFL if NEMU runs under it,
+ * otherwise a private one is used.
+ */
+void init_fuzz(const char *input, uint32_t timeout) {
+	fuzzing = true;
+	input_file = input;
+	timeout_ms = timeout;
+
+	const char *shm_id = getenv(SHM_ENV_VAR);
+	if(shm_id != NULL) {
+		void *p = shmat(atoi(shm_id), NULL, 0);
+		Assert(p != (void *)-1, "Can not attach the coverage map");
+		shm_area = p;
+	}
+	else {
+		shm_area = calloc(FUZZ_MAP_SIZE, 1);
+		assert(shm_area);
+	}
+}
+
+bool fuzz_enabled() {
+	return fuzzing;
+}
+
+static void fuzz_timeout(int sig) {
+	fprintf(stderr, "nemu: timeout after %u ms at eip = 0x%08x\n", timeout_ms, cpu.eip);
+	_exit(FUZZ_EXIT_TIMEOUT);
+}
+
+/* Copy the input into the buffer given by the guest. */
+static void fuzz_inject() {
+	static uint8_t buf[FUZZ_INPUT_MAX];
+	int fd = (input_file ? open(input_file, O_RDONLY) : STDIN_FILENO);
+	Assert(fd >= 0, "Can not open '%s'", input_file);
+
+	size_t size = (cpu.edx < FUZZ_INPUT_MAX ? cpu.edx : FUZZ_INPUT_MAX);
+	size_t len = 0;
+	ssize_t ret;
+	while(len < size && (ret = read(fd, buf + len, size - len)) > 0) {
+		len += ret;
+	}
+	if(input_file) { close(fd); }
+
+	/* The input is copied in by the monitor, not by the program. */
+	size_t i;
+	for(i = 0; i < len; i ++) {
+		swaddr_write_raw(cpu.ecx + i, 1, buf[i], R_DS);
+	}
+	cpu.eax = len;
+}
+
+/* Set up a run from the current state, which is the state of the
+ * fork server when it is forked.
+ */
+static void fuzz_run() {
+	if(timeout_ms > 0) {
+		struct itimerval it = { { 0, 0 }, { timeout_ms / 1000, (timeout_ms % 1000) * 1000 } };
+		signal(SIGALRM, fuzz_timeout);
+		setitimer(ITIMER_REAL, &it, NULL);
+	}
+
+	prev_loc = 0;
+	fuzz_area = shm_area;
+	fuzz_inject();
+}
+
+/* Called when the guest reaches the marker. The fork server forks a child
+ * for each input, and only the children return from here to run the rest
+ * of the program. Without AFL the program runs once.
+ */
+void fuzz_start() {
+	if(!fuzzing) {
+		cpu.eax = 0;
+		return;
+	}
+
+	uint32_t msg = 0;
+	if(write(FORKSRV_FD + 1, &msg, 4) != 4) {
+		fuzz_run();
+		return;
+	}
+
+	while(1) {
+		if(read(FORKSRV_FD, &msg, 4) != 4) { _exit(0); }
+
+		pid_t pid = fork();
+		Assert(pid >= 0, "Can not fork");
+		if(pid == 0) {
+			close(FORKSRV_FD);
+			close(FORKSRV_FD + 1);
+			fuzz_run();
+			return;
+		}
+
+		int status;
+		if(write(FORKSRV_FD + 1, &pid, 4) != 4) { _exit(1); }
+		if(waitpid(pid, &status, 0) < 0) { _exit(1); }
+		if(write(FORKSRV_FD + 1, &status, 4) != 4) { _exit(1); }
+	}
+}
+
+/* Run the program without the user interface. A BAD TRAP is turned into
+ * abort(), so that AFL takes it as a crash.
+ */
+void fuzz_mainloop() {
+	cpu_exec(-1);
+	if(nemu_state != END || cpu.eax != 0) {
+		abort();
+	}
+	exit(0);
+}
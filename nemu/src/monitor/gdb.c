@@ -0,0 +1,589 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/gdb.h"
+#include "monitor/breakpoint.h"
+#include "monitor/watchpoint.h"
+#include "monitor/reverse.h"
+#include "memory/dirty.h"
+
+#include <stdlib.h>
+#include <ctype.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+/* The largest packet accepted, it is told to gdb by qSupported. */
+#define GDB_PACKET_SIZE 0x4000
+
+/* A running program is interrupted by gdb with this byte. The socket is
+ * polled for it after so many instructions.
+ */
+#define GDB_INTR 0x03
+#define GDB_POLL_INSNS (1 << 20)
+
+/* the registers in the order of org.gnu.gdb.i386.core, the x87 ones
+ * are not emulated and read as zero
+ */
+#define NR_GDB_REG 32
+#define GDB_REGS_SIZE (16 * 4 + 8 * 10 + 8 * 4)
+
+void cpu_exec(uint32_t);
+void init_ddr3();
+
+static const char *gdb_addr = NULL;
+static int listen_fd = -1;
+static int conn_fd = -1;
+static bool no_ack = false;
+
+static uint8_t rbuf[4096];
+static int rpos = 0, rlen = 0;
+
+static const char target_xml[] =
+	"<?xml version=\"1.0\"?>\n"
+	"<!DOCTYPE target SYSTEM \"gdb-target.dtd\">\n"
+	"<target version=\"1.0\">\n"
+	"<architecture>i386</architecture>\n"
+	"<feature name=\"org.gnu.gdb.i386.core\">\n"
+	"<reg name=\"eax\" bitsize=\"32\" type=\"int32\" regnum=\"0\"/>\n"
+	"<reg name=\"ecx\" bitsize=\"32\" type=\"int32\"/>\n"
+	"<reg name=\"edx\" bitsize=\"32\" type=\"int32\"/>\n"
+	"<reg name=\"ebx\" bitsize=\"32\" type=\"int32\"/>\n"
+	"<reg name=\"esp\" bitsize=\"32\" type=\"data_ptr\"/>\n"
+	"<reg name=\"ebp\" bitsize=\"32\" type=\"data_ptr\"/>\n"
+	"<reg name=\"esi\" bitsize=\"32\" type=\"int32\"/>\n"
+	"<reg name=\"edi\" bitsize=\"32\" type=\"int32\"/>\n"
+	"<reg name=\"eip\" bitsize=\"32\" type=\"code_ptr\"/>\n"
+	"<reg name=\"eflags\" bitsize=\"32\" type=\"int32\"/>\n"
+	"<reg name=\"cs\" bitsize=\"32\" type=\"int32\"/>\n"
+	"<reg name=\"ss\" bitsize=\"32\" type=\"int32\"/>\n"
+	"<reg name=\"ds\" bitsize=\"32\" type=\"int32\"/>\n"
+	"<reg name=\"es\" bitsize=\"32\" type=\"int32\"/>\n"
+	"<reg name=\"fs\" bitsize=\"32\" type=\"int32\"/>\n"
+	"<reg name=\"gs\" bitsize=\"32\" type=\"int32\"/>\n"
+	"<reg name=\"st0\" bitsize=\"80\" type=\"i387_ext\"/>\n"
+	"<reg name=\"st1\" bitsize=\"80\" type=\"i387_ext\"/>\n"
+	"<reg name=\"st2\" bitsize=\"80\" type=\"i387_ext\"/>\n"
+	"<reg name=\"st3\" bitsize=\"80\" type=\"i387_ext\"/>\n"
+	"<reg name=\"st4\" bitsize=\"80\" type=\"i387_ext\"/>\n"
+	"<reg name=\"st5\" bitsize=\"80\" type=\"i387_ext\"/>\n"
+	"<reg name=\"st6\" bitsize=\"80\" type=\"i387_ext\"/>\n"
+	"<reg name=\"st7\" bitsize=\"80\" type=\"i387_ext\"/>\n"
+	"<reg name=\"fctrl\" bitsize=\"32\" type=\"int\" group=\"float\"/>\n"
+	"<reg name=\"fstat\" bitsize=\"32\" type=\"int\" group=\"float\"/>\n"
+	"<reg name=\"ftag\" bitsize=\"32\" type=\"int\" group=\"float\"/>\n"
+	"<reg name=\"fiseg\" bitsize=\"32\" type=\"int\" group=\"float\"/>\n"
+	"<reg name=\"fioff\" bitsize=\"32\" type=\"int\" group=\"float\"/>\n"
+	"<reg name=\"foseg\" bitsize=\"32\" type=\"int\" group=\"float\"/>\n"
+	"<reg name=\"fooff\" bitsize=\"32\" type=\"int\" group=\"float\"/>\n"
+	"<reg name=\"fop\" bitsize=\"32\" type=\"int\" group=\"float\"/>\n"
+	"</feature>\n"
+	"</target>\n";
+
+/* the segment registers in the order of gdb */
+static const uint8_t gdb_sreg[] = { R_CS, R_SS, R_DS, R_ES, R_FS, R_GS };
+
+void init_gdb(const char *addr) {
+	gdb_addr = addr;
+
+	bool is_port = (*addr != '\0');
+	const char *p;
+	for(p = addr; *p; p ++) {
+		if(!isdigit(*p)) { is_port = false; }
+	}
+
+	if(is_port) {
+		struct sockaddr_in sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sin_family = AF_INET;
+		sa.sin_port = htons(atoi(addr));
+		sa.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+
+		listen_fd = socket(AF_INET, SOCK_STREAM, 0);
+		int one = 1;
+		setsockopt(listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+		Assert(listen_fd >= 0 && bind(listen_fd, (struct sockaddr *)&sa, sizeof(sa)) == 0,
+				"Can not listen on port %s", addr);
+	}
+	else {
+		struct sockaddr_un sa;
+		memset(&sa, 0, sizeof(sa));
+		sa.sun_family = AF_UNIX;
+		Assert(strlen(addr) < sizeof(sa.sun_path), "socket path '%s' is too long", addr);
+		strcpy(sa.sun_path, addr);
+		unlink(addr);
+
+		listen_fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		Assert(listen_fd >= 0 && bind(listen_fd, (struct sockaddr *)&sa, sizeof(sa)) == 0,
+				"Can not listen on '%s'", addr);
+	}
+
+	Assert(listen(listen_fd, 1) == 0, "Can not listen on '%s'", addr);
+}
+
+bool gdb_enabled() {
+	return gdb_addr != NULL;
+}
+
+/* Packet I/O */
+
+static int gdb_getc() {
+	if(rpos == rlen) {
+		ssize_t n = read(conn_fd, rbuf, sizeof(rbuf));
+		if(n <= 0) { return -1; }
+		rpos = 0;
+		rlen = n;
+	}
+	return rbuf[rpos ++];
+}
+
+static void gdb_write(const char *buf, size_t len) {
+	while(len > 0) {
+		ssize_t n = write(conn_fd, buf, len);
+		if(n <= 0) { return; }
+		buf += n;
+		len -= n;
+	}
+}
+
+static int hex_val(int c) {
+	if(c >= '0' && c <= '9') { return c - '0'; }
+	if(c >= 'a' && c <= 'f') { return c - 'a' + 10; }
+	if(c >= 'A' && c <= 'F') { return c - 'A' + 10; }
+	return -1;
+}
+
+static uint32_t parse_hex(const char **s) {
+	uint32_t val = 0;
+	int d;
+	while((d = hex_val(**s)) >= 0) {
+		val = (val << 4) | d;
+		(*s) ++;
+	}
+	return val;
+}
+
+static char *put_hex(char *p, const uint8_t *data, int len) {
+	static const char digit[] = "0123456789abcdef";
+	int i;
+	for(i = 0; i < len; i ++) {
+		*p ++ = digit[data[i] >> 4];
+		*p ++ = digit[data[i] & 0xf];
+	}
+	*p = '\0';
+	return p;
+}
+
+/* Receive a packet into `buf'. Return its length, or -1 if gdb has gone. */
+static int recv_packet(char *buf) {
+	while(1) {
+		int c;
+		do {
+			if((c = gdb_getc()) < 0) { return -1; }
+		} while(c != '$');
+
+		int len = 0;
+		uint8_t sum = 0;
+		while((c = gdb_getc()) != '#') {
+			if(c < 0) { return -1; }
+			if(len < GDB_PACKET_SIZE - 1) { buf[len ++] = c; }
+			sum += c;
+		}
+
+		int hi = hex_val(gdb_getc());
+		int lo = hex_val(gdb_getc());
+		bool ok = (hi >= 0 && lo >= 0 && ((hi << 4) | lo) == sum);
+		if(!no_ack) { gdb_write(ok ? "+" : "-", 1); }
+		if(ok) {
+			buf[len] = '\0';
+			return len;
+		}
+	}
+}
+
+static void send_packet(const char *data, int len) {
+	static char out[GDB_PACKET_SIZE * 2 + 4];
+	assert(len <= GDB_PACKET_SIZE * 2);
+
+	uint8_t sum = 0;
+	int i;
+	out[0] = '$';
+	for(i = 0; i < len; i ++) {
+		out[i + 1] = data[i];
+		sum += (uint8_t)data[i];
+	}
+	sprintf(out + len + 1, "#%02x", sum);
+
+	int c;
+	do {
+		gdb_write(out, len + 4);
+		if(no_ack) { return; }
+		while((c = gdb_getc()) >= 0 && c != '+' && c != '-');
+	} while(c == '-');
+}
+
+static void send_str(const char *str) {
+	send_packet(str, strlen(str));
+}
+
+/* Registers */
+
+static int reg_size(int no) {
+	return (no >= 16 && no < 24 ? 10 : 4);
+}
+
+static uint32_t get_reg(int no) {
+	if(no < 8) { return reg_l(no); }
+	if(no == 8) { return cpu.eip; }
+	if(no == 9) { return cpu.eflags.val; }
+	if(no < 16) { return cpu.sreg[gdb_sreg[no - 10]].selector; }
+	return 0;
+}
+
+/* The hidden part of a segment register can not be reloaded by gdb,
+ * so only the same selector can be written back.
+ */
+static bool set_reg(int no, uint32_t val) {
+	if(no < 8) { reg_l(no) = val; }
+	else if(no == 8) { cpu.eip = val; }
+	else if(no == 9) { cpu.eflags.val = val; }
+	else if(no < 16) { return val == cpu.sreg[gdb_sreg[no - 10]].selector; }
+	return true;
+}
+
+static void read_regs(char *out) {
+	uint8_t buf[GDB_REGS_SIZE];
+	memset(buf, 0, sizeof(buf));
+	int no;
+	for(no = 0; no < 16; no ++) {
+		uint32_t val = get_reg(no);
+		memcpy(buf + no * 4, &val, 4);
+	}
+	put_hex(out, buf, sizeof(buf));
+}
+
+static bool write_regs(const char *in) {
+	int no;
+	for(no = 0; no < 16; no ++) {
+		uint32_t val = 0;
+		int i;
+		for(i = 0; i < 4; i ++) {
+			int hi = hex_val(in[0]), lo = hex_val(in[1]);
+			if(hi < 0 || lo < 0) { return false; }
+			val |= ((hi << 4) | lo) << (i * 8);
+			in += 2;
+		}
+		if(!set_reg(no, val)) { return false; }
+	}
+	return true;
+}
+
+/* Memory is accessed through the host pointer, so that the accesses by gdb
+ * neither trigger watchpoints nor have side effects on devices.
+ */
+static uint8_t *gdb_mem_ptr(swaddr_t addr, size_t *len, lnaddr_t *lnaddr) {
+	SegReg *s = &cpu.ds;
+	if(!s->flat) {
+		if(addr > s->limit) { return NULL; }
+		if(*len - 1 > s->limit - addr) { *len = s->limit - addr + 1; }
+		addr += s->base;
+	}
+	if(addr + *len - 1 < addr) { *len = -addr; }
+	*lnaddr = addr;
+	return pmem_host_ptr(addr, len);
+}
+
+static void read_mem(swaddr_t addr, size_t len, char *out) {
+	size_t done = 0;
+	while(done < len) {
+		size_t n = len - done;
+		lnaddr_t lnaddr;
+		uint8_t *p = gdb_mem_ptr(addr + done, &n, &lnaddr);
+		if(p == NULL) { break; }
+		out = put_hex(out, p, n);
+		done += n;
+	}
+	if(done == 0) { strcpy(out, "E01"); }
+}
+
+static bool write_mem(swaddr_t addr, size_t len, const uint8_t *data) {
+	size_t done = 0;
+	while(done < len) {
+		size_t n = len - done;
+		lnaddr_t lnaddr;
+		uint8_t *p = gdb_mem_ptr(addr + done, &n, &lnaddr);
+		if(p == NULL) { break; }
+		memcpy(p, data + done, n);
+		dirty_mark_range(lnaddr, n);
+		done += n;
+	}
+
+	/* Memory is written behind the back of DRAM. */
+	init_ddr3();
+	reverse_reset();
+	return done == len;
+}
+
+/* Breakpoints and watchpoints */
+
+static bool insert_point(int type, swaddr_t addr, uint32_t kind) {
+	static const int wp_type[] = { [2] = WP_WRITE, [3] = WP_READ, [4] = WP_ACCESS };
+	if(type <= 1) {
+		return new_bp(addr, false, NULL) != NULL;
+	}
+	return kind > 0 && addr + kind - 1 >= addr && new_range_wp(wp_type[type], addr, kind) != NULL;
+}
+
+static bool remove_point(int type, swaddr_t addr, uint32_t kind) {
+	static const int wp_type[] = { [2] = WP_WRITE, [3] = WP_READ, [4] = WP_ACCESS };
+	if(type <= 1) {
+		BP *bp = find_bp_at(addr);
+		if(bp) { free_bp(bp); }
+		return bp != NULL;
+	}
+	WP *wp = find_range_wp(wp_type[type], addr, kind);
+	if(wp) { free_wp(wp); }
+	return wp != NULL;
+}
+
+/* Execution */
+
+static bool interrupted() {
+	struct pollfd pfd = { .fd = conn_fd, .events = POLLIN };
+	while(rpos < rlen || poll(&pfd, 1, 0) > 0) {
+		int c = gdb_getc();
+		if(c < 0 || c == GDB_INTR) { return true; }
+	}
+	return false;
+}
+
+static void stop_reply(bool intr, char *out) {
+	if(nemu_state == END) {
+		sprintf(out, "W%02x", (cpu.eax == 0 ? 0 : 1));
+	}
+	else if(intr) {
+		strcpy(out, "T02");
+	}
+	else if(hit_wp != NULL) {
+		static const char *name[] = { [WP_WRITE] = "watch", [WP_READ] = "rwatch", [WP_ACCESS] = "awatch" };
+		swaddr_t addr = (hit_wp->hit_addr > hit_wp->addr ? hit_wp->hit_addr : hit_wp->addr);
+		sprintf(out, "T05%s:%08x;", name[hit_wp->type], addr);
+	}
+	else if(bp_hit) {
+		strcpy(out, "T05swbreak:;");
+	}
+	else {
+		strcpy(out, "T05");
+	}
+}
+
+/* Run until a breakpoint or a watchpoint is hit, the program ends, or gdb
+ * interrupts. The program runs in cpu_exec() as it does without gdb, the
+ * socket is only polled between the batches of instructions.
+ */
+static void resume(bool step, char *out) {
+	hit_wp = NULL;
+	bp_hit = false;
+	bool intr = false;
+	if(step) {
+		cpu_exec(1);
+	}
+	else {
+		while(1) {
+			cpu_exec(GDB_POLL_INSNS);
+			if(nemu_state == END || hit_wp != NULL || bp_hit) { break; }
+			if((intr = interrupted())) { break; }
+		}
+	}
+	stop_reply(intr, out);
+}
+
+/* qXfer:features:read:target.xml:OFFSET,LENGTH */
+static void read_features(const char *args, char *out) {
+	const char *annex = "target.xml:";
+	if(strncmp(args, annex, strlen(annex)) != 0) {
+		strcpy(out, "E00");
+		return;
+	}
+	args += strlen(annex);
+	uint32_t off = parse_hex(&args);
+	if(*args ++ != ',') {
+		strcpy(out, "E00");
+		return;
+	}
+	uint32_t len = parse_hex(&args);
+	if(len > GDB_PACKET_SIZE / 2) { len = GDB_PACKET_SIZE / 2; }
+
+	uint32_t size = sizeof(target_xml) - 1;
+	if(off >= size) {
+		strcpy(out, "l");
+		return;
+	}
+	if(len > size - off) { len = size - off; }
+	*out = (off + len < size ? 'm' : 'l');
+	memcpy(out + 1, target_xml + off, len);
+	out[len + 1] = '\0';
+}
+
+static void handle_query(const char *pkt, char *out) {
+	if(strncmp(pkt, "qSupported", 10) == 0) {
+		sprintf(out, "PacketSize=%x;qXfer:features:read+;swbreak+;hwbreak+;QStartNoAckMode+;ReverseStep+;ReverseContinue+", GDB_PACKET_SIZE);
+	}
+	else if(strncmp(pkt, "qXfer:features:read:", 20) == 0) { read_features(pkt + 20, out); }
+	else if(strcmp(pkt, "qAttached") == 0) { strcpy(out, "1"); }
+	else if(strcmp(pkt, "qC") == 0) { strcpy(out, "QC1"); }
+	else if(strcmp(pkt, "qfThreadInfo") == 0) { strcpy(out, "m1"); }
+	else if(strcmp(pkt, "qsThreadInfo") == 0) { strcpy(out, "l"); }
+	else if(strncmp(pkt, "qSymbol", 7) == 0) { strcpy(out, "OK"); }
+}
+
+/* Handle a packet, and return false when gdb detaches. */
+static bool handle_packet(char *pkt, int len) {
+	static char out[GDB_PACKET_SIZE * 2 + 1];
+	static uint8_t data[GDB_PACKET_SIZE];
+	const char *p = pkt + 1;
+	out[0] = '\0';
+
+	switch(pkt[0]) {
+		case '?': stop_reply(false, out); break;
+		case 'g': read_regs(out); break;
+		case 'G':
+			strcpy(out, (write_regs(p) ? "OK" : "E01"));
+			reverse_reset();
+			break;
+		case 'p': {
+			int no = parse_hex(&p);
+			if(no >= NR_GDB_REG) { strcpy(out, "E01"); break; }
+			uint8_t buf[10];
+			memset(buf, 0, sizeof(buf));
+			uint32_t val = get_reg(no);
+			memcpy(buf, &val, 4);
+			put_hex(out, buf, reg_size(no));
+			break;
+		}
+		case 'P': {
+			int no = parse_hex(&p);
+			if(no >= NR_GDB_REG || *p ++ != '=') { strcpy(out, "E01"); break; }
+			uint32_t val = 0;
+			int i;
+			for(i = 0; i < 4 && hex_val(p[0]) >= 0 && hex_val(p[1]) >= 0; i ++, p += 2) {
+				val |= ((hex_val(p[0]) << 4) | hex_val(p[1])) << (i * 8);
+			}
+			strcpy(out, (set_reg(no, val) ? "OK" : "E01"));
+			reverse_reset();
+			break;
+		}
+		case 'm': {
+			swaddr_t addr = parse_hex(&p);
+			if(*p ++ != ',') { strcpy(out, "E01"); break; }
+			size_t n = parse_hex(&p);
+			if(n > GDB_PACKET_SIZE / 2) { n = GDB_PACKET_SIZE / 2; }
+			read_mem(addr, n, out);
+			break;
+		}
+		case 'M':
+		case 'X': {
+			swaddr_t addr = parse_hex(&p);
+			if(*p ++ != ',') { strcpy(out, "E01"); break; }
+			size_t n = parse_hex(&p);
+			if(*p ++ != ':' || n > GDB_PACKET_SIZE) { strcpy(out, "E01"); break; }
+
+			/* The data of `X' is binary, with '}' escaping the next byte. */
+			const char *end = pkt + len;
+			size_t i;
+			for(i = 0; i < n && p < end; i ++) {
+				if(pkt[0] == 'M') {
+					data[i] = (hex_val(p[0]) << 4) | hex_val(p[1]);
+					p += 2;
+				}
+				else if(*p == '}') {
+					data[i] = p[1] ^ 0x20;
+					p += 2;
+				}
+				else {
+					data[i] = *p ++;
+				}
+			}
+			strcpy(out, (i == n && write_mem(addr, n, data) ? "OK" : "E01"));
+			break;
+		}
+		case 'c':
+		case 's':
+			if(*p) {
+				cpu.eip = parse_hex(&p);
+				reverse_reset();
+			}
+			resume(pkt[0] == 's', out);
+			break;
+		case 'b':
+			/* bs and bc, stepping and continuing backwards */
+			if(pkt[1] == 's' || pkt[1] == 'c') {
+				hit_wp = NULL;
+				bp_hit = false;
+				bool ok = (pkt[1] == 's' ? reverse_stepi(1) : reverse_continue());
+				if(ok) { stop_reply(false, out); }
+				else { strcpy(out, "T05replaylog:begin;"); }
+			}
+			break;
+		case 'Z':
+		case 'z': {
+			int type = parse_hex(&p);
+			if(type > 4 || *p ++ != ',') { break; }
+			swaddr_t addr = parse_hex(&p);
+			if(*p ++ != ',') { strcpy(out, "E01"); break; }
+			uint32_t kind = parse_hex(&p);
+			bool ok = (pkt[0] == 'Z' ? insert_point(type, addr, kind) : remove_point(type, addr, kind));
+			strcpy(out, (ok ? "OK" : "E01"));
+			break;
+		}
+		case 'H':
+		case 'T': strcpy(out, "OK"); break;
+		case 'q': handle_query(pkt, out); break;
+		case 'Q':
+			if(strcmp(pkt, "QStartNoAckMode") == 0) {
+				send_str("OK");
+				no_ack = true;
+				return true;
+			}
+			break;
+		case 'v':
+			if(strncmp(pkt, "vKill", 5) == 0) {
+				send_str("OK");
+				exit(0);
+			}
+			break;
+		case 'k': exit(0);
+		case 'D':
+			send_str("OK");
+			return false;
+	}
+
+	send_str(out);
+	return true;
+}
+
+/* Serve one gdb session. When gdb detaches, the user interface of NEMU
+ * takes over.
+ */
+void gdb_mainloop() {
+	printf("Waiting for gdb on %s\n", gdb_addr);
+	conn_fd = accept(listen_fd, NULL, NULL);
+	Assert(conn_fd >= 0, "Can not accept the connection from gdb");
+	int one = 1;
+	setsockopt(conn_fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+	no_ack = false;
+	rpos = rlen = 0;
+
+	static char pkt[GDB_PACKET_SIZE];
+	int len;
+	while((len = recv_packet(pkt)) >= 0) {
+		if(!handle_packet(pkt, len)) { break; }
+	}
+
+	close(conn_fd);
+	conn_fd = -1;
+	printf("gdb detached\n");
+}
@@ -0,0 +1,69 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/hashtrace.h"
+
+#include <stdlib.h>
+
+bool hashtrace_on = false;
+uint64_t hashtrace_hash;
+uint32_t hashtrace_countdown;
+
+static FILE *trace_fp = NULL;
+static uint32_t interval;
+static uint64_t last_count;
+
+static void write_record() {
+	int i;
+	for(i = R_EAX; i <= R_EDI; i ++) {
+		hashtrace_hash = hashtrace_mix(hashtrace_hash, reg_l(i));
+	}
+	hashtrace_hash = hashtrace_mix(hashtrace_mix(hashtrace_hash, cpu.eflags.val), cpu.eip);
+
+	HashTraceRecord r = { instr_count, hashtrace_hash, cpu.eip, 0 };
+	fwrite(&r, sizeof(r), 1, trace_fp);
+	last_count = instr_count;
+}
+
+void hashtrace_record() {
+	hashtrace_countdown = interval;
+	write_record();
+}
+
+/* The hash starts from the state when the trace starts, so the runs to be
+ * compared should start the trace at the same point, as the option
+ * `--hash-trace' does.
+ */
+bool hashtrace_start(const char *file, uint32_t nr) {
+	assert(nr > 0);
+	if(hashtrace_on) { hashtrace_stop(); }
+
+	trace_fp = fopen(file, "w");
+	if(trace_fp == NULL) {
+		printf("Can not open '%s'\n", file);
+		return false;
+	}
+
+	HashTraceHeader h = { HASHTRACE_MAGIC, sizeof(HashTraceRecord), nr };
+	fwrite(&h, sizeof(h), 1, trace_fp);
+
+	static bool registered = false;
+	if(!registered) {
+		atexit(hashtrace_stop);
+		registered = true;
+	}
+
+	interval = nr;
+	hashtrace_countdown = nr;
+	hashtrace_hash = 14695981039346656037ull;
+	last_count = instr_count;
+	hashtrace_on = true;
+	return true;
+}
+
+void hashtrace_stop() {
+	if(!hashtrace_on) { return; }
+	if(instr_count != last_count) { write_record(); }
+	hashtrace_on = false;
+	fclose(trace_fp);
+	trace_fp = NULL;
+}
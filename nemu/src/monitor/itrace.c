@@ -0,0 +1,104 @@
+#include "nemu.h"
+#include "monitor/itrace.h"
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+ITraceRecord *itrace_cur = NULL;
+
+static ITraceHeader *header;
+static ITraceRecord *ring, *ring_end;
+static size_t map_size;
+
+/* the host address of the last code page */
+static uint32_t code_page = -1;
+static uint8_t *code_host;
+
+/* The bytes are copied from RAM without going through the memory
+ * interfaces. The length is not known for instructions which set eip,
+ * so the maximal length is always copied.
+ */
+static void fetch_instr(uint8_t *buf, swaddr_t eip) {
+	lnaddr_t addr = (cpu.cs.flat ? eip : swaddr_translate(eip, 1, R_CS));
+	if((addr >> 12) == code_page && (addr & 0xfff) + ITRACE_INSTR_LEN <= 0x1000) {
+		memcpy(buf, code_host + (addr & 0xfff), ITRACE_INSTR_LEN);
+		return;
+	}
+
+	size_t n = ITRACE_INSTR_LEN;
+	uint8_t *p = pmem_host_ptr(addr, &n);
+	memset(buf, 0, ITRACE_INSTR_LEN);
+	if(p == NULL) { return; }
+	if(addr + n - 1 < addr) { n = -addr; }
+	memcpy(buf, p, n);
+	code_page = addr >> 12;
+	code_host = p - (addr & 0xfff);
+}
+
+/* Called after the instruction at `eip' is executed. */
+void itrace_record(swaddr_t eip, int len) {
+	ITraceRecord *r = itrace_cur;
+	r->eip = eip;
+	memcpy(r->gpr, cpu.gpr, sizeof(r->gpr));
+	r->eflags = cpu.eflags.val;
+	r->len = len;
+	fetch_instr(r->instr, eip);
+	header->count ++;
+
+	if(++ r == ring_end) { r = ring; }
+	r->nr_mem = 0;
+	itrace_cur = r;
+}
+
+/* Trace the last `nr' instructions into `file'. The file is mapped shared,
+ * so the trace survives a crash of NEMU.
+ */
+bool itrace_start(const char *file, uint32_t nr) {
+	assert(nr > 0);
+	if(itrace_cur) { itrace_stop(); }
+
+	int fd = open(file, O_RDWR | O_CREAT | O_TRUNC, 0644);
+	if(fd < 0) {
+		printf("Can not open '%s'\n", file);
+		return false;
+	}
+
+	map_size = sizeof(ITraceHeader) + (size_t)nr * sizeof(ITraceRecord);
+	void *p = MAP_FAILED;
+	if(ftruncate(fd, map_size) == 0) {
+		p = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	}
+	close(fd);
+	if(p == MAP_FAILED) {
+		printf("Can not map '%s' with %u records\n", file, nr);
+		return false;
+	}
+
+	header = p;
+	memcpy(header->magic, ITRACE_MAGIC, sizeof(header->magic));
+	header->record_size = sizeof(ITraceRecord);
+	header->nr_record = nr;
+	header->count = 0;
+
+	ring = (void *)(header + 1);
+	ring_end = ring + nr;
+	ring->nr_mem = 0;
+	code_page = -1;
+
+	static bool registered = false;
+	if(!registered) {
+		atexit(itrace_stop);
+		registered = true;
+	}
+
+	itrace_cur = ring;
+	return true;
+}
+
+void itrace_stop() {
+	if(!itrace_cur) { return; }
+	itrace_cur = NULL;
+	munmap(header, map_size);
+}
@@ -0,0 +1,207 @@
+#include "common.h"
+
+#include <stdlib.h>
+#include <stdarg.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sched.h>
+#include <time.h>
+#include <pthread.h>
+
+/* Messages are formatted by the emulation thread into a ring, which is
+ * the only producer. A writer thread is the only consumer, it writes
+ * whatever is in the ring with one write(). It sleeps until the ring is
+ * not empty, then until a batch is ready or LOG_DELAY_MS has passed. The
+ * producer only takes the lock to wake it up.
+ */
+#define LOG_BUF_SIZE (1 << 22)
+#define LOG_LINE_MAX 1024
+#define LOG_BATCH (1 << 16)
+#define LOG_DELAY_MS 50
+
+static char ring[LOG_BUF_SIZE];
+/* the bytes produced and the bytes written, the ring holds [tail, head) */
+static uint64_t head, tail;
+
+static int log_fd = -1;
+static bool async = false;
+static bool stopping = false;
+static pthread_t writer;
+/* taken by the writer and by log_flush(), so that a byte is written once */
+static pthread_mutex_t drain_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/* what the writer is waiting for, under `lock' */
+enum { WRITER_BUSY, WRITER_WAIT_DATA, WRITER_WAIT_BATCH };
+static int writer_state = WRITER_BUSY;
+static pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+
+static void write_all(const char *buf, size_t len) {
+	while(len > 0) {
+		ssize_t n = write(log_fd, buf, len);
+		if(n <= 0) { return; }
+		buf += n;
+		len -= n;
+	}
+}
+
+static void drain() {
+	uint64_t h = __atomic_load_n(&head, __ATOMIC_ACQUIRE);
+	uint64_t t = tail;
+	if(h == t) { return; }
+
+	uint32_t start = t % LOG_BUF_SIZE;
+	uint64_t len = h - t;
+	if(start + len > LOG_BUF_SIZE) {
+		write_all(ring + start, LOG_BUF_SIZE - start);
+		write_all(ring, len - (LOG_BUF_SIZE - start));
+	}
+	else {
+		write_all(ring + start, len);
+	}
+	__atomic_store_n(&tail, h, __ATOMIC_RELEASE);
+}
+
+/* Wait until there is something to write, return false when the writer
+ * should stop. The state is set before the ring is checked, so that the
+ * producer either sees it or its message is seen here.
+ */
+static bool wait_for_batch() {
+	pthread_mutex_lock(&lock);
+	__atomic_store_n(&writer_state, WRITER_WAIT_DATA, __ATOMIC_SEQ_CST);
+	while(__atomic_load_n(&head, __ATOMIC_SEQ_CST) == tail && !__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+		pthread_cond_wait(&cond, &lock);
+	}
+
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_nsec += LOG_DELAY_MS * 1000000L;
+	if(deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec ++;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	__atomic_store_n(&writer_state, WRITER_WAIT_BATCH, __ATOMIC_SEQ_CST);
+	while(__atomic_load_n(&head, __ATOMIC_SEQ_CST) - tail < LOG_BATCH && !__atomic_load_n(&stopping, __ATOMIC_ACQUIRE)) {
+		if(pthread_cond_timedwait(&cond, &lock, &deadline) != 0) { break; }
+	}
+
+	__atomic_store_n(&writer_state, WRITER_BUSY, __ATOMIC_SEQ_CST);
+	bool stop = (__atomic_load_n(&stopping, __ATOMIC_ACQUIRE) && __atomic_load_n(&head, __ATOMIC_ACQUIRE) == tail);
+	pthread_mutex_unlock(&lock);
+	return !stop;
+}
+
+static void *writer_thread(void *arg) {
+	while(wait_for_batch()) {
+		pthread_mutex_lock(&drain_lock);
+		drain();
+		pthread_mutex_unlock(&drain_lock);
+	}
+	return NULL;
+}
+
+static void wake_writer() {
+	pthread_mutex_lock(&lock);
+	pthread_cond_signal(&cond);
+	pthread_mutex_unlock(&lock);
+}
+
+void log_printf(const char *fmt, ...) {
+	char line[LOG_LINE_MAX];
+	va_list ap;
+	va_start(ap, fmt);
+	int len = vsnprintf(line, sizeof(line), fmt, ap);
+	va_end(ap);
+	if(len < 0) { return; }
+	if(len >= sizeof(line)) { len = sizeof(line) - 1; }
+
+	if(!async) {
+		write_all(line, len);
+		return;
+	}
+
+	/* Wait for the writer if the ring is full. */
+	while(head + len - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) > LOG_BUF_SIZE) {
+		sched_yield();
+	}
+
+	uint32_t start = head % LOG_BUF_SIZE;
+	if(start + len > LOG_BUF_SIZE) {
+		memcpy(ring + start, line, LOG_BUF_SIZE - start);
+		memcpy(ring, line + (LOG_BUF_SIZE - start), len - (LOG_BUF_SIZE - start));
+	}
+	else {
+		memcpy(ring + start, line, len);
+	}
+	__atomic_store_n(&head, head + len, __ATOMIC_SEQ_CST);
+
+	int state = __atomic_load_n(&writer_state, __ATOMIC_SEQ_CST);
+	if(state == WRITER_WAIT_DATA ||
+			(state == WRITER_WAIT_BATCH && head - __atomic_load_n(&tail, __ATOMIC_ACQUIRE) >= LOG_BATCH)) {
+		wake_writer();
+	}
+}
+
+/* Write out the ring on the calling thread. It is called on panic, and
+ * from the handler of a fatal signal, where the writer thread may hold
+ * the lock forever, so the lock is only tried for a while.
+ */
+void log_flush() {
+	if(!async) { return; }
+
+	int i;
+	bool locked = false;
+	for(i = 0; i < 1000 && !(locked = (pthread_mutex_trylock(&drain_lock) == 0)); i ++) {
+		usleep(100);
+	}
+	drain();
+	if(locked) { pthread_mutex_unlock(&drain_lock); }
+}
+
+static void log_stop() {
+	if(!async) { return; }
+	__atomic_store_n(&stopping, true, __ATOMIC_RELEASE);
+	wake_writer();
+	pthread_join(writer, NULL);
+	drain();
+	async = false;
+}
+
+static void crash_handler(int sig) {
+	log_flush();
+	signal(sig, SIG_DFL);
+	raise(sig);
+}
+
+/* The child of fork() has no writer thread. The messages of the parent
+ * left in the ring belong to the parent.
+ */
+static void after_fork_child() {
+	if(!async) { return; }
+	tail = head;
+	async = false;
+	pthread_mutex_init(&drain_lock, NULL);
+	pthread_mutex_init(&lock, NULL);
+	pthread_cond_init(&cond, NULL);
+}
+
+/* Start writing the log into `fd' in the background. */
+void init_log_writer(int fd) {
+	int i;
+	log_fd = fd;
+	head = tail = 0;
+	__atomic_store_n(&stopping, false, __ATOMIC_RELEASE);
+	writer_state = WRITER_BUSY;
+
+	int ret = pthread_create(&writer, NULL, writer_thread, NULL);
+	Assert(ret == 0, "Can not create the writer thread for log");
+	async = true;
+
+	atexit(log_stop);
+	pthread_atfork(NULL, NULL, after_fork_child);
+
+	int sigs[] = { SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+	for(i = 0; i < sizeof(sigs) / sizeof(sigs[0]); i ++) {
+		signal(sigs[i], crash_handler);
+	}
+}
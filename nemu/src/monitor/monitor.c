@@ -1,4 +1,22 @@
 #include "nemu.h"
+#include "memory/dirty.h"
+#include "monitor/fuzz.h"
+#include "monitor/gdb.h"
+#include "monitor/batch.h"
+#include "monitor/itrace.h"
+#include "monitor/profile.h"
+#include "monitor/callgrind.h"
+#include "monitor/coverage.h"
+#include "monitor/hashtrace.h"
+#include "monitor/reverse.h"
+#include "monitor/replay.h"
+
+#include <stdlib.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 
 #define ENTRY_START 0x100000
 
@@ -6,16 +24,177 @@ extern uint8_t entry [];
 extern uint32_t entry_len;
 extern char *exec_file;
 
-void load_elf_tables(int, char *[]);
-void init_regex();
+void load_elf_tables();
 void init_wp_pool();
+void init_bp_pool();
 void init_ddr3();
+void init_pmem_map();
 
 FILE *log_fp = NULL;
 
+static bool huge_page = false;
+static bool fuzz = false;
+static const char *fuzz_input = NULL;
+static uint32_t fuzz_timeout = 1000;
+static const char *gdb_addr = NULL;
+static bool batch = false;
+static uint64_t max_instr = 0;
+static uint32_t timeout = 0;
+static const char *stats_file = NULL;
+static bool exit_code = false;
+static bool no_log = false;
+static const char *log_file = NULL;
+static const char *itrace_file = NULL;
+static uint32_t itrace_len = ITRACE_DEFAULT_LEN;
+static const char *profile_file = NULL;
+static uint32_t profile_rate = PROFILE_DEFAULT_RATE;
+static const char *callgrind_file = NULL;
+static const char *coverage_file = NULL;
+static const char *hashtrace_file = NULL;
+static uint32_t hashtrace_interval = HASHTRACE_DEFAULT_INTERVAL;
+static uint32_t reverse_interval = 0;
+static uint32_t reverse_budget = REVERSE_DEFAULT_BUDGET;
+static const char *record_file = NULL;
+static const char *replay_file = NULL;
+
+/* The size of guest RAM is given in MB, or with a K/M/G suffix, and is
+ * at most HW_MEM_SIZE_LIMIT.
+ */
+#ifdef USE_RAMDISK
+#define MEM_SIZE_USAGE "SIZE is at most 3584M, below the ramdisk at 0xe0000000"
+#else
+#define MEM_SIZE_USAGE "SIZE is at most 4G"
+#endif
+
+static size_t parse_mem_size(const char *str) {
+	char *end;
+	unsigned long long size = strtoull(str, &end, 0);
+	int shift = 20;
+	switch(*end) {
+		case 'k': case 'K': shift = 10; end ++; break;
+		case 'm': case 'M': shift = 20; end ++; break;
+		case 'g': case 'G': shift = 30; end ++; break;
+	}
+	Assert(*end == '\0' && size > 0 && size <= (HW_MEM_SIZE_LIMIT >> shift),
+			"invalid size of guest RAM '%s', it should be at most %lluMB", str,
+			(unsigned long long)(HW_MEM_SIZE_LIMIT >> 20));
+
+	size <<= shift;
+	Assert((size & (PMEM_PAGE_SIZE - 1)) == 0, "size of guest RAM should be a multiple of 4KB");
+	return size;
+}
+
+static void parse_args(int argc, char *argv[]) {
+	const struct option table[] = {
+		{"mem",        required_argument, NULL, 'm'},
+		{"huge-pages", no_argument,       NULL, 'H'},
+		{"fuzz",       no_argument,       NULL, 'f'},
+		{"fuzz-input", required_argument, NULL, 'i'},
+		{"fuzz-timeout", required_argument, NULL, 't'},
+		{"gdb",        required_argument, NULL, 'g'},
+		{"batch",      no_argument,       NULL, 'b'},
+		{"max-insns",  required_argument, NULL, 'n'},
+		{"timeout",    required_argument, NULL, 'T'},
+		{"stats",      required_argument, NULL, 's'},
+		{"exit-code",  no_argument,       NULL, 'e'},
+		{"log",        required_argument, NULL, 'l'},
+		{"no-log",     no_argument,       NULL, 'L'},
+		{"itrace",     required_argument, NULL, 'I'},
+		{"itrace-len", required_argument, NULL, 'N'},
+		{"profile",    required_argument, NULL, 'p'},
+		{"profile-rate", required_argument, NULL, 'r'},
+		{"callgrind",  required_argument, NULL, 'c'},
+		{"coverage",   required_argument, NULL, 'C'},
+		{"hash-trace", required_argument, NULL, 'h'},
+		{"hash-interval", required_argument, NULL, 'k'},
+		{"reverse",    required_argument, NULL, 'R'},
+		{"reverse-budget", required_argument, NULL, 'B'},
+		{"record",     required_argument, NULL, 'w'},
+		{"replay",     required_argument, NULL, 'y'},
+		{0,            0,                 NULL,  0 },
+	};
+
+	const char *usage = "run NEMU with format 'nemu [-m SIZE] [--huge-pages] "
+		"[--fuzz [--fuzz-input FILE] [--fuzz-timeout MS]] [--gdb PORT|SOCKET] "
+		"[-b [--max-insns N] [--timeout SEC] [--stats FILE] [--exit-code]] "
+		"[--log FILE|--no-log] [--itrace FILE [--itrace-len N]] "
+		"[--profile FILE [--profile-rate N]] [--callgrind FILE] "
+		"[--coverage FILE] [--hash-trace FILE [--hash-interval N]] [--reverse N [--reverse-budget MB]] [--record FILE|--replay FILE] [program]', "
+		MEM_SIZE_USAGE;
+
+	int o;
+	while((o = getopt_long(argc, argv, "m:b", table, NULL)) != -1) {
+		switch(o) {
+			case 'm': hw_mem_size = parse_mem_size(optarg); break;
+			case 'H': huge_page = true; break;
+			case 'f': fuzz = true; break;
+			case 'i': fuzz_input = optarg; break;
+			case 't': fuzz_timeout = atoi(optarg); break;
+			case 'g': gdb_addr = optarg; break;
+			case 'b': batch = true; break;
+			case 'n': max_instr = strtoull(optarg, NULL, 0); break;
+			case 'T': timeout = atoi(optarg); break;
+			case 's': stats_file = optarg; break;
+			case 'e': exit_code = true; break;
+			case 'l': log_file = optarg; no_log = false; break;
+			case 'L': no_log = true; break;
+			case 'I': itrace_file = optarg; break;
+			case 'N': itrace_len = atoi(optarg); break;
+			case 'p': profile_file = optarg; break;
+			case 'r': profile_rate = atoi(optarg); break;
+			case 'c': callgrind_file = optarg; break;
+			case 'C': coverage_file = optarg; break;
+			case 'h': hashtrace_file = optarg; break;
+			case 'k': hashtrace_interval = atoi(optarg); break;
+			case 'R': reverse_interval = atoi(optarg); break;
+			case 'B': reverse_budget = atoi(optarg); break;
+			case 'w': record_file = optarg; break;
+			case 'y': replay_file = optarg; break;
+			default: panic("%s", usage);
+		}
+	}
+
+	Assert(optind + 1 == argc, "%s", usage);
+	exec_file = argv[optind];
+}
+
+#define NR_EXIT_DUMP 8
+
+static struct {
+	dump_func_t dump;
+	const char *file;
+} exit_dumps[NR_EXIT_DUMP];
+static int nr_exit_dump = 0;
+
+/* in the reverse order of registration, as atexit() does */
+static void run_exit_dumps() {
+	int i;
+	for(i = nr_exit_dump - 1; i >= 0; i --) {
+		exit_dumps[i].dump(exit_dumps[i].file);
+	}
+}
+
+void dump_at_exit(dump_func_t dump, const char *file) {
+	assert(nr_exit_dump < NR_EXIT_DUMP);
+	if(nr_exit_dump == 0) {
+		atexit(run_exit_dumps);
+	}
+	exit_dumps[nr_exit_dump].dump = dump;
+	exit_dumps[nr_exit_dump].file = file;
+	nr_exit_dump ++;
+}
+
 static void init_log() {
-	log_fp = fopen("log.txt", "w");
-	Assert(log_fp, "Can not open 'log.txt'");
+	/* The runs of a fuzzer are too many to log, and a program in batch mode
+	 * is only logged on request.
+	 */
+	if(log_file == NULL && (fuzz || batch)) { no_log = true; }
+	if(no_log) { return; }
+
+	if(log_file == NULL) { log_file = "log.txt"; }
+	log_fp = fopen(log_file, "w");
+	Assert(log_fp, "Can not open '%s'", log_file);
+	init_log_writer(fileno(log_fp));
 }
 
 static void welcome() {
@@ -26,70 +205,165 @@ static void welcome() {
 void init_monitor(int argc, char *argv[]) {
 	/* Perform some global initialization */
 
+	/* Parse the command line options. */
+	parse_args(argc, argv);
+
 	/* Open the log file. */
 	init_log();
 
-	/* Load the string table and symbol table from the ELF file for future use. */
-	load_elf_tables(argc, argv);
+	/* Allocate guest RAM. */
+	init_hw_mem(huge_page);
+
+	/* Set up the physical memory map before any device adds its MMIO region. */
+	init_pmem_map();
 
-	/* Compile the regular expressions. */
-	init_regex();
+	/* Load the string table and symbol table from the ELF file for future use. */
+	load_elf_tables();
 
-	/* Initialize the watchpoint pool. */
+	/* Initialize the watchpoint pool and the breakpoint pool. */
 	init_wp_pool();
+	init_bp_pool();
+
+	if(fuzz) {
+		/* Attach the coverage map, the fork server starts at the marker. */
+		init_fuzz(fuzz_input, fuzz_timeout);
+	}
+
+	if(itrace_file) {
+		/* Trace the instructions from the very beginning. */
+		bool ok = (itrace_len > 0 && itrace_start(itrace_file, itrace_len));
+		Assert(ok, "Can not trace into '%s'", itrace_file);
+	}
+
+	if(profile_file) {
+		/* Profile the whole run, the samples are written at exit. */
+		Assert(profile_rate > 0, "invalid sampling rate of profile");
+		profile_start(profile_rate);
+		dump_at_exit(profile_dump, profile_file);
+	}
+
+	if(callgrind_file) {
+		/* Count the whole run, the costs are written at exit. */
+		callgrind_start();
+		dump_at_exit(callgrind_dump, callgrind_file);
+	}
+
+	if(coverage_file) {
+		/* Cover the whole run, the bitmap is written at exit. */
+		coverage_start();
+		dump_at_exit(coverage_dump, coverage_file);
+	}
+
+	if(hashtrace_file) {
+		/* Hash the whole run, so that runs can be compared from the start. */
+		bool ok = (hashtrace_interval > 0 && hashtrace_start(hashtrace_file, hashtrace_interval));
+		Assert(ok, "Can not trace the hashes into '%s'", hashtrace_file);
+	}
+
+	if(record_file || replay_file) {
+		/* The events of devices are recorded or replayed from the very
+		 * beginning, before the devices are initialized.
+		 */
+		Assert(!(record_file && replay_file), "Can not record and replay at the same time");
+		bool ok = (record_file ? replay_record_start(record_file) : replay_play_start(replay_file));
+		Assert(ok, "Can not %s the events", (record_file ? "record" : "replay"));
+	}
+
+	if(reverse_interval > 0) {
+		/* The history starts again when the program is loaded. */
+		Assert(reverse_budget > 0, "invalid memory budget of reverse execution");
+		reverse_start(reverse_interval, reverse_budget);
+	}
+
+	if(gdb_addr) {
+		/* Listen for gdb, it connects after the program is loaded. */
+		init_gdb(gdb_addr);
+	}
+
+	if(batch) {
+		/* Run to the end without the user interface. */
+		init_batch(max_instr, timeout, stats_file, exit_code);
+		return;
+	}
 
 	/* Display welcome message. */
 	welcome();
 }
 
+/* Place the content of `file' at physical address `addr'. The file is
+ * mapped copy-on-write, so only the pages touched by the guest are read
+ * from it, and writes from the guest never reach the file. If the file
+ * can not be mapped, it is read into guest memory instead.
+ */
+static size_t load_file(const char *file, hwaddr_t addr, size_t max_size) {
+	int fd = open(file, O_RDONLY);
+	Assert(fd >= 0, "Can not open '%s'", file);
+
+	struct stat st;
+	int ret = fstat(fd, &st);
+	assert(ret == 0);
+	size_t file_size = st.st_size;
+	Assert(file_size <= max_size, "file size(%zd) of '%s' too large", file_size, file);
+
+	if(file_size > 0) {
+		void *p = mmap(hwa_to_va(addr), file_size, PROT_READ | PROT_WRITE,
+				MAP_PRIVATE | MAP_FIXED, fd, 0);
+		if(p == MAP_FAILED) {
+			ssize_t nread = pread(fd, hwa_to_va(addr), file_size, 0);
+			Assert(nread == file_size, "Can not read '%s'", file);
+		}
+	}
+
+	close(fd);
+	return file_size;
+}
+
 #ifdef USE_RAMDISK
 static void init_ramdisk() {
-	int ret;
-	const int ramdisk_max_size = 0xa0000;
-	FILE *fp = fopen(exec_file, "rb");
-	Assert(fp, "Can not open '%s'", exec_file);
-
-	fseek(fp, 0, SEEK_END);
-	size_t file_size = ftell(fp);
-	Assert(file_size < ramdisk_max_size, "file size(%zd) too large", file_size);
-
-	fseek(fp, 0, SEEK_SET);
-	ret = fread(hwa_to_va(0), file_size, 1, fp);
-	assert(ret == 1);
-	fclose(fp);
+	load_file(exec_file, RAMDISK_START, RAMDISK_SIZE);
 }
 #endif
 
 static void load_entry() {
-	int ret;
-	FILE *fp = fopen("entry", "rb");
-	Assert(fp, "Can not open 'entry'");
-
-	fseek(fp, 0, SEEK_END);
-	size_t file_size = ftell(fp);
-
-	fseek(fp, 0, SEEK_SET);
-	ret = fread(hwa_to_va(ENTRY_START), file_size, 1, fp);
-	assert(ret == 1);
-	fclose(fp);
+	Assert(ENTRY_START < hw_mem_size, "guest RAM is too small for 'entry'");
+	load_file("entry", ENTRY_START, hw_mem_size - ENTRY_START);
 }
 
-void restart() {
-	/* Perform some initialization to restart a program */
+/* Put guest memory back to the state when the program is loaded. */
+void reset_memory() {
+	/* Discard the content of guest RAM. */
+	reset_hw_mem();
+
 #ifdef USE_RAMDISK
-	/* Read the file with name `argv[1]' into ramdisk. */
+	/* Map the file with name `argv[1]' into ramdisk. */
 	init_ramdisk();
 #endif
 
-	/* Read the entry code into memory. */
+	/* Map the entry code into memory. */
 	load_entry();
 
-	/* Set the initial instruction pointer. */
+	/* Track dirty pages from the freshly loaded state. */
+	dirty_reset();
+}
+
+void restart() {
+	/* Perform some initialization to restart a program */
+
+	reset_memory();
+
+	/* Set the initial instruction pointer, the first basic block starts here. */
 	cpu.eip = ENTRY_START;
+	coverage_block(cpu.eip);
 
 	/* Initialize EFLAGS register according to i386 manual */
 	cpu.eflags.val = 0x00000002;
 
+	/* Initialize segment registers and CR0, segmentation is disabled. */
+	init_sreg();
+
 	/* Initialize DRAM. */
 	init_ddr3();
+
+	/* Reverse execution can not go back before the program is loaded. */
+	reverse_reset();
 }
@@ -0,0 +1,125 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/perf.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <time.h>
+
+#define NR_TOP_OPCODE 16
+
+PerfCounters perf;
+PerfDev perf_dev[NR_PERF_DEV];
+static int nr_perf_dev = 0;
+
+static double exec_start;
+static uint64_t exec_start_count;
+
+static double now() {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec * 1e-9;
+}
+
+int perf_add_dev(const char *name) {
+	if(nr_perf_dev == NR_PERF_DEV) {
+		strcpy(perf_dev[NR_PERF_DEV - 1].name, "others");
+		return NR_PERF_DEV - 1;
+	}
+	PerfDev *d = &perf_dev[nr_perf_dev];
+	strncpy(d->name, name, sizeof(d->name) - 1);
+	return nr_perf_dev ++;
+}
+
+/* Called when cpu_exec() starts and returns. */
+void perf_exec_begin() {
+	exec_start = now();
+	exec_start_count = instr_count;
+}
+
+void perf_exec_end() {
+	perf.time += now() - exec_start;
+	perf.nr_instr += instr_count - exec_start_count;
+}
+
+/* Called around the work which is not counted, such as the replay of
+ * reverse execution. The counters are put back as they were.
+ */
+static PerfCounters perf_saved;
+static PerfDev perf_dev_saved[NR_PERF_DEV];
+
+void perf_pause() {
+	perf_saved = perf;
+	memcpy(perf_dev_saved, perf_dev, sizeof(perf_dev));
+}
+
+void perf_resume() {
+	perf = perf_saved;
+	memcpy(perf_dev, perf_dev_saved, sizeof(perf_dev));
+}
+
+void perf_reset() {
+	memset(&perf, 0, sizeof(perf));
+	int i;
+	for(i = 0; i < nr_perf_dev; i ++) {
+		perf_dev[i].nr_read = perf_dev[i].nr_write = 0;
+	}
+}
+
+static int cmp_opcode(const void *a, const void *b) {
+	uint64_t x = perf.opcode[*(const int *)a], y = perf.opcode[*(const int *)b];
+	return (x < y) - (x > y);
+}
+
+static double percent(uint64_t n, uint64_t total) {
+	return (total ? 100.0 * n / total : 0);
+}
+
+void perf_print(FILE *fp) {
+	fprintf(fp, "instructions      %" PRIu64 "\n", perf.nr_instr);
+	fprintf(fp, "host time         %.3f s\n", perf.time);
+	fprintf(fp, "speed             %.3f MIPS\n", (perf.time > 0 ? perf.nr_instr / perf.time / 1e6 : 0));
+
+	static const char *access_name[] = { "reads", "writes", "fetches" };
+	int i, j;
+	for(i = 0; i < NR_PERF_ACCESS; i ++) {
+		uint64_t *a = perf.access[i];
+		fprintf(fp, "memory %-10s %" PRIu64 " (1 byte %" PRIu64 ", 2 bytes %" PRIu64 ", 4 bytes %" PRIu64 ")\n",
+				access_name[i], a[1] + a[2] + a[4], a[1], a[2], a[4]);
+	}
+	fprintf(fp, "cross-burst       %" PRIu64 "\n", perf.cross_burst);
+
+	for(i = 0; i < nr_perf_dev; i ++) {
+		PerfDev *d = &perf_dev[i];
+		if(d->nr_read + d->nr_write == 0) { continue; }
+		fprintf(fp, "%-17s %" PRIu64 " reads, %" PRIu64 " writes\n", d->name, d->nr_read, d->nr_write);
+	}
+
+	uint64_t nr_irq = 0;
+	for(i = 0; i < NR_PERF_IRQ; i ++) {
+		nr_irq += perf.irq_raised[i];
+	}
+	fprintf(fp, "interrupts        %" PRIu64 " raised, %" PRIu64 " delivered\n", nr_irq, perf.intr);
+	for(i = 0; i < NR_PERF_IRQ; i ++) {
+		if(perf.irq_raised[i]) { fprintf(fp, "  IRQ %-2d          %" PRIu64 "\n", i, perf.irq_raised[i]); }
+	}
+
+	fprintf(fp, "prefixes          %" PRIu64 " 66, %" PRIu64 " f3, %" PRIu64 " f2\n",
+			perf.prefix[PERF_PREFIX_OPSIZE], perf.prefix[PERF_PREFIX_REP], perf.prefix[PERF_PREFIX_REPNZ]);
+
+	/* The opcodes executed most, one for each instruction. */
+	int order[NR_PERF_OPCODE];
+	uint64_t total = 0;
+	for(i = 0; i < NR_PERF_OPCODE; i ++) {
+		order[i] = i;
+		total += perf.opcode[i];
+	}
+	qsort(order, NR_PERF_OPCODE, sizeof(order[0]), cmp_opcode);
+	fprintf(fp, "opcodes executed  %" PRIu64 "\n", total);
+	for(j = 0; j < NR_TOP_OPCODE && perf.opcode[order[j]] > 0; j ++) {
+		int op = order[j];
+		char name[16];
+		sprintf(name, (op < 256 ? "%02x" : "0f %02x"), op & 0xff);
+		fprintf(fp, "  %-8s %14" PRIu64 "  %5.1f%%\n", name, perf.opcode[op], percent(perf.opcode[op], total));
+	}
+}
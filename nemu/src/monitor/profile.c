@@ -0,0 +1,220 @@
+#include "nemu.h"
+#include "monitor/profile.h"
+#include "monitor/elf.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+/* Each sample is a call stack found by walking the ebp chain, as `bt'
+ * does. The samples are counted per distinct stack of addresses, and the
+ * stacks are only symbolized when they are written out.
+ */
+#define PROFILE_MAX_DEPTH 64
+
+uint32_t profile_countdown = -1;
+
+static bool profiling = false;
+static uint32_t sample_rate;
+
+typedef struct {
+	uint32_t hash;
+	uint32_t depth;
+	uint32_t offset;
+	uint64_t count;
+} Stack;
+
+static Stack *stacks = NULL;
+static uint32_t nr_stack, stack_cap;
+/* the addresses of all stacks, innermost first */
+static swaddr_t *addrs = NULL;
+static uint32_t nr_addr, addr_cap;
+/* hash table of the indices of stacks plus one, 0 for an empty slot */
+static uint32_t *table = NULL;
+static uint32_t table_size;
+
+/* Read a word of the stack directly from RAM, a broken chain must not
+ * cause a panic or touch devices.
+ */
+static bool read_stack(swaddr_t addr, uint32_t *val) {
+	SegReg *s = &cpu.ss;
+	if(!s->flat) {
+		if(addr > s->limit || s->limit - addr < 3) { return false; }
+		addr += s->base;
+	}
+	size_t len = 4;
+	uint8_t *p = pmem_host_ptr(addr, &len);
+	if(p == NULL || len < 4) { return false; }
+	memcpy(val, p, 4);
+	return true;
+}
+
+static int walk_stack(swaddr_t *frame) {
+	int depth = 0;
+	frame[depth ++] = cpu.eip;
+
+	uint32_t ebp = cpu.ebp, ret_addr, next;
+	while(ebp != 0 && depth < PROFILE_MAX_DEPTH) {
+		if(!read_stack(ebp + 4, &ret_addr) || !read_stack(ebp, &next)) { break; }
+		frame[depth ++] = ret_addr;
+		/* The caller's frame is above, a chain going down is broken. */
+		if(next <= ebp) { break; }
+		ebp = next;
+	}
+	return depth;
+}
+
+static uint32_t hash_stack(const swaddr_t *frame, int depth) {
+	uint32_t h = 2166136261u;
+	int i;
+	for(i = 0; i < depth; i ++) {
+		h = (h ^ frame[i]) * 16777619u;
+	}
+	return h;
+}
+
+static void insert(uint32_t idx) {
+	uint32_t i = stacks[idx].hash & (table_size - 1);
+	while(table[i] != 0) { i = (i + 1) & (table_size - 1); }
+	table[i] = idx + 1;
+}
+
+static void add_stack(const swaddr_t *frame, int depth, uint32_t h) {
+	if(nr_stack == stack_cap) {
+		stack_cap = (stack_cap ? stack_cap * 2 : 1024);
+		stacks = realloc(stacks, stack_cap * sizeof(Stack));
+		assert(stacks);
+	}
+	while(nr_addr + depth > addr_cap) {
+		addr_cap = (addr_cap ? addr_cap * 2 : 16384);
+		addrs = realloc(addrs, addr_cap * sizeof(swaddr_t));
+		assert(addrs);
+	}
+	memcpy(addrs + nr_addr, frame, depth * sizeof(swaddr_t));
+	stacks[nr_stack] = (Stack) { h, depth, nr_addr, 1 };
+	nr_addr += depth;
+
+	if((nr_stack + 1) * 2 > table_size) {
+		table_size *= 2;
+		free(table);
+		table = calloc(table_size, sizeof(uint32_t));
+		assert(table);
+		uint32_t i;
+		for(i = 0; i < nr_stack; i ++) { insert(i); }
+	}
+	insert(nr_stack ++);
+}
+
+void profile_sample() {
+	if(!profiling) {
+		profile_countdown = -1;
+		return;
+	}
+	profile_countdown = sample_rate;
+
+	swaddr_t frame[PROFILE_MAX_DEPTH];
+	int depth = walk_stack(frame);
+	uint32_t h = hash_stack(frame, depth);
+
+	uint32_t i = h & (table_size - 1);
+	for(; table[i] != 0; i = (i + 1) & (table_size - 1)) {
+		Stack *s = &stacks[table[i] - 1];
+		if(s->hash == h && s->depth == depth && memcmp(addrs + s->offset, frame, depth * sizeof(swaddr_t)) == 0) {
+			s->count ++;
+			return;
+		}
+	}
+	add_stack(frame, depth, h);
+}
+
+/* Sample the call stack every `rate' instructions. */
+void profile_start(uint32_t rate) {
+	assert(rate > 0);
+	free(stacks);
+	free(addrs);
+	free(table);
+	stacks = NULL;
+	addrs = NULL;
+	nr_stack = stack_cap = nr_addr = addr_cap = 0;
+	table_size = 1024;
+	table = calloc(table_size, sizeof(uint32_t));
+	assert(table);
+
+	sample_rate = rate;
+	profiling = true;
+	profile_countdown = rate;
+}
+
+void profile_stop() {
+	profiling = false;
+	profile_countdown = -1;
+}
+
+typedef struct {
+	char *line;
+	uint64_t count;
+} Folded;
+
+static int cmp_folded(const void *a, const void *b) {
+	return strcmp(((Folded *)a)->line, ((Folded *)b)->line);
+}
+
+/* A return address is looked up by the call instruction before it. */
+static const char *frame_name(swaddr_t addr, bool is_ret, char *buf, size_t size) {
+	const Elf32_Sym *sym = find_symbol(is_ret && addr > 0 ? addr - 1 : addr, STT_FUNC);
+	if(sym) { return strtab + sym->st_name; }
+	snprintf(buf, size, "0x%08x", addr);
+	return buf;
+}
+
+/* Write the samples as folded stacks, one line of `outer;...;inner COUNT'
+ * for each distinct stack of functions, which flamegraph.pl takes.
+ */
+bool profile_dump(const char *file) {
+	FILE *fp = fopen(file, "w");
+	if(fp == NULL) {
+		printf("Can not open '%s'\n", file);
+		return false;
+	}
+
+	Folded *folded = malloc((nr_stack ? nr_stack : 1) * sizeof(Folded));
+	assert(folded);
+	uint64_t total = 0;
+	uint32_t i;
+	for(i = 0; i < nr_stack; i ++) {
+		Stack *s = &stacks[i];
+		total += s->count;
+		size_t len = 0, cap = 256;
+		char *line = malloc(cap);
+		int j;
+		for(j = s->depth - 1; j >= 0; j --) {
+			char buf[16];
+			const char *name = frame_name(addrs[s->offset + j], j > 0, buf, sizeof(buf));
+			size_t n = strlen(name);
+			while(len + n + 2 > cap) {
+				cap *= 2;
+				line = realloc(line, cap);
+			}
+			memcpy(line + len, name, n);
+			len += n;
+			line[len ++] = (j > 0 ? ';' : '\0');
+		}
+		folded[i] = (Folded) { line, s->count };
+	}
+
+	/* Different addresses in the same functions give the same line. */
+	qsort(folded, nr_stack, sizeof(Folded), cmp_folded);
+	for(i = 0; i < nr_stack; i ++) {
+		if(i + 1 < nr_stack && strcmp(folded[i].line, folded[i + 1].line) == 0) {
+			folded[i + 1].count += folded[i].count;
+		}
+		else {
+			fprintf(fp, "%s %" PRIu64 "\n", folded[i].line, folded[i].count);
+		}
+		free(folded[i].line);
+	}
+	free(folded);
+	fclose(fp);
+
+	printf("%" PRIu64 " samples of %u stacks written to '%s'\n", total, nr_stack, file);
+	return true;
+}
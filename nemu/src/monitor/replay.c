@@ -0,0 +1,114 @@
+#include "monitor/replay.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+int replay_mode = REPLAY_OFF;
+uint64_t replay_next = -1ull;
+
+static event_handler_t handlers[NR_EVENT];
+static FILE *event_fp = NULL;
+static EventRecord next_event;
+static uint64_t nr_event;
+
+void replay_set_handler(int type, event_handler_t handler) {
+	assert(type >= 0 && type < NR_EVENT);
+	handlers[type] = handler;
+}
+
+static void deliver(int type, uint32_t data) {
+	if(handlers[type]) {
+		handlers[type](data);
+	}
+}
+
+void replay_event(int type, uint32_t data) {
+	assert(type >= 0 && type < NR_EVENT);
+	if(replay_mode == REPLAY_PLAY) { return; }
+
+	if(replay_mode == REPLAY_RECORD) {
+		EventRecord r = { instr_count, type, data };
+		bool ok = (fwrite(&r, sizeof(r), 1, event_fp) == 1);
+		Assert(ok, "Can not record the event");
+		nr_event ++;
+	}
+	deliver(type, data);
+}
+
+static void read_next() {
+	if(fread(&next_event, sizeof(next_event), 1, event_fp) == 1 && next_event.type < NR_EVENT) {
+		replay_next = next_event.count;
+		return;
+	}
+
+	replay_next = -1ull;
+	printf("Replay ends after %" PRIu64 " events at instruction %" PRIu64 "\n", nr_event, instr_count);
+}
+
+void replay_deliver() {
+	while(instr_count >= replay_next) {
+		if(instr_count != replay_next) {
+			/* The execution is not the one recorded. */
+			Log("event %" PRIu64 " is late, recorded at instruction %" PRIu64 " but delivered at %" PRIu64,
+					nr_event, replay_next, instr_count);
+		}
+		deliver(next_event.type, next_event.data);
+		nr_event ++;
+		read_next();
+	}
+}
+
+void replay_stop() {
+	if(event_fp) {
+		fclose(event_fp);
+		event_fp = NULL;
+	}
+	replay_mode = REPLAY_OFF;
+	replay_next = -1ull;
+}
+
+static FILE *open_events(const char *file, const char *mode) {
+	static bool registered = false;
+	if(!registered) {
+		atexit(replay_stop);
+		registered = true;
+	}
+	replay_stop();
+	nr_event = 0;
+
+	FILE *fp = fopen(file, mode);
+	if(fp == NULL) {
+		printf("Can not open '%s'\n", file);
+	}
+	return fp;
+}
+
+bool replay_record_start(const char *file) {
+	event_fp = open_events(file, "wb");
+	if(event_fp == NULL) { return false; }
+
+	EventHeader h = { EVENT_MAGIC, sizeof(EventRecord), 0 };
+	if(fwrite(&h, sizeof(h), 1, event_fp) != 1) {
+		printf("Can not write to '%s'\n", file);
+		replay_stop();
+		return false;
+	}
+	replay_mode = REPLAY_RECORD;
+	return true;
+}
+
+bool replay_play_start(const char *file) {
+	event_fp = open_events(file, "rb");
+	if(event_fp == NULL) { return false; }
+
+	EventHeader h;
+	if(fread(&h, sizeof(h), 1, event_fp) != 1 || memcmp(h.magic, EVENT_MAGIC, sizeof(h.magic)) != 0 ||
+			h.record_size != sizeof(EventRecord)) {
+		printf("'%s' is not a record of events of NEMU\n", file);
+		replay_stop();
+		return false;
+	}
+	replay_mode = REPLAY_PLAY;
+	read_next();
+	return true;
+}
@@ -0,0 +1,382 @@
+#include "nemu.h"
+#include "monitor/reverse.h"
+#include "monitor/watchpoint.h"
+#include "monitor/breakpoint.h"
+#include "monitor/snapshot.h"
+#include "monitor/itrace.h"
+#include "monitor/ftrace.h"
+#include "monitor/callgrind.h"
+#include "monitor/hashtrace.h"
+#include "monitor/perf.h"
+#include "monitor/fuzz.h"
+#include "memory/mtrace.h"
+#include "memory/dirty.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+
+void init_ddr3();
+int exec(swaddr_t);
+void cpu_exec(uint32_t);
+
+/* Reverse execution goes back to the nearest checkpoint before the target,
+ * and replays the program forward from there. Without devices the replay
+ * is deterministic.
+ *
+ * A checkpoint holds the state at instruction `count', and the old content
+ * of the pages first written after it, up to the next checkpoint. To go
+ * back to a checkpoint, the pages saved by it and by all later ones are
+ * copied back from the latest to it.
+ */
+typedef struct {
+	uint64_t count;
+	CPU_state cpu;
+	uint8_t *dev;
+	uint32_t nr_page, max_page;
+	uint32_t *page_no;
+	uint8_t **page;
+} Checkpoint;
+
+static Checkpoint *ckpts;
+static int nr_ckpt, max_ckpt;
+
+static uint32_t interval;
+static size_t budget, used;
+static size_t dev_size;
+
+uint64_t reverse_next = -1ull;
+
+/* pages saved by the checkpoint before the one being merged into it */
+static uint64_t merge_bitmap[NR_DIRTY_WORD];
+
+static size_t ckpt_size() {
+	return sizeof(Checkpoint) + dev_size;
+}
+
+/* the pages which are RAM in the physical memory map, the ramdisk included */
+static uint64_t ram_bitmap[NR_DIRTY_WORD];
+
+static void build_ram_bitmap() {
+	uint32_t i;
+	memset(ram_bitmap, 0, sizeof(ram_bitmap));
+	for(i = 0; i < NR_PMEM_PAGE; i ++) {
+		if(pmem_map[i] == PMEM_RAM) {
+			ram_bitmap[i >> 6] |= 1ull << (i & 63);
+		}
+	}
+}
+
+/* Every page of RAM is saved before its next write. */
+static void arm_cow() {
+	memcpy(cow_bitmap, ram_bitmap, sizeof(cow_bitmap));
+}
+
+static void add_page(Checkpoint *c, uint32_t no, uint8_t *data) {
+	if(c->nr_page == c->max_page) {
+		c->max_page = (c->max_page ? c->max_page * 2 : 64);
+		c->page_no = realloc(c->page_no, c->max_page * sizeof(c->page_no[0]));
+		c->page = realloc(c->page, c->max_page * sizeof(c->page[0]));
+		assert(c->page_no && c->page);
+	}
+	c->page_no[c->nr_page] = no;
+	c->page[c->nr_page] = data;
+	c->nr_page ++;
+}
+
+static void free_pages(Checkpoint *c) {
+	uint32_t i;
+	for(i = 0; i < c->nr_page; i ++) {
+		if(c->page[i]) {
+			free(c->page[i]);
+			used -= PMEM_PAGE_SIZE;
+		}
+	}
+	c->nr_page = 0;
+}
+
+static void free_ckpt(Checkpoint *c) {
+	free_pages(c);
+	free(c->page_no);
+	free(c->page);
+	free(c->dev);
+	used -= ckpt_size();
+}
+
+void cow_fault(uint32_t page) {
+	cow_bitmap[page >> 6] &= ~(1ull << (page & 63));
+	if(nr_ckpt == 0 || pmem_map[page] != PMEM_RAM) { return; }
+
+	uint8_t *data = malloc(PMEM_PAGE_SIZE);
+	assert(data);
+	memcpy(data, hwa_to_va(page << PMEM_PAGE_SHIFT), PMEM_PAGE_SIZE);
+	add_page(&ckpts[nr_ckpt - 1], page, data);
+	used += PMEM_PAGE_SIZE;
+}
+
+/* Merge checkpoint `j' into the one before it. A page saved only by `j'
+ * is not written between the two, so its content is the same at both.
+ */
+static void merge_ckpt(int j) {
+	assert(j > 0 && j < nr_ckpt - 1);
+	Checkpoint *prev = &ckpts[j - 1], *c = &ckpts[j];
+	uint32_t i;
+	for(i = 0; i < prev->nr_page; i ++) {
+		uint32_t no = prev->page_no[i];
+		merge_bitmap[no >> 6] |= 1ull << (no & 63);
+	}
+	for(i = 0; i < c->nr_page; i ++) {
+		uint32_t no = c->page_no[i];
+		if(merge_bitmap[no >> 6] & (1ull << (no & 63))) { continue; }
+		add_page(prev, no, c->page[i]);
+		c->page[i] = NULL;
+	}
+	for(i = 0; i < prev->nr_page; i ++) {
+		uint32_t no = prev->page_no[i];
+		merge_bitmap[no >> 6] &= ~(1ull << (no & 63));
+	}
+
+	free_ckpt(c);
+	memmove(c, c + 1, (nr_ckpt - j - 1) * sizeof(*c));
+	nr_ckpt --;
+}
+
+static void drop_oldest() {
+	free_ckpt(&ckpts[0]);
+	memmove(ckpts, ckpts + 1, (nr_ckpt - 1) * sizeof(ckpts[0]));
+	nr_ckpt --;
+}
+
+/* Keep the memory used within the budget. The checkpoint removed is the
+ * one leaving the smallest gap compared with its age, so that the old
+ * checkpoints become sparse. The oldest is dropped at last.
+ */
+static void thin_out() {
+	while(used > budget && nr_ckpt > 1) {
+		if(nr_ckpt == 2) {
+			drop_oldest();
+			continue;
+		}
+
+		int j, best = 1;
+		double best_score = 0;
+		for(j = 1; j < nr_ckpt - 1; j ++) {
+			double gap = ckpts[j + 1].count - ckpts[j - 1].count;
+			double score = gap / (instr_count - ckpts[j].count + 1);
+			if(j == 1 || score < best_score) {
+				best = j;
+				best_score = score;
+			}
+		}
+		merge_ckpt(best);
+	}
+}
+
+void reverse_checkpoint() {
+	if(nr_ckpt == max_ckpt) {
+		max_ckpt = (max_ckpt ? max_ckpt * 2 : 64);
+		ckpts = realloc(ckpts, max_ckpt * sizeof(ckpts[0]));
+		assert(ckpts);
+	}
+
+	Checkpoint *c = &ckpts[nr_ckpt ++];
+	memset(c, 0, sizeof(*c));
+	c->count = instr_count;
+	c->cpu = cpu;
+	c->dev = malloc(dev_size ? dev_size : 1);
+	assert(c->dev);
+	snapshot_regions_save(c->dev);
+	used += ckpt_size();
+
+	arm_cow();
+	reverse_next = instr_count + interval;
+	thin_out();
+}
+
+/* Go back to checkpoint `k'. The later checkpoints are dropped, they are
+ * taken again when the program runs forward.
+ */
+static void restore_ckpt(int k) {
+	int j;
+	for(j = nr_ckpt - 1; j >= k; j --) {
+		Checkpoint *c = &ckpts[j];
+		uint32_t i;
+		for(i = 0; i < c->nr_page; i ++) {
+			uint32_t no = c->page_no[i];
+			memcpy(hwa_to_va(no << PMEM_PAGE_SHIFT), c->page[i], PMEM_PAGE_SIZE);
+		}
+	}
+
+	/* The pages copied back are written as far as others can tell. */
+	memset(cow_bitmap, 0, sizeof(cow_bitmap));
+	for(j = nr_ckpt - 1; j >= k; j --) {
+		Checkpoint *c = &ckpts[j];
+		uint32_t i;
+		for(i = 0; i < c->nr_page; i ++) {
+			dirty_mark_page(c->page_no[i]);
+		}
+		if(j > k) { free_ckpt(c); }
+	}
+	free_pages(&ckpts[k]);
+	nr_ckpt = k + 1;
+
+	Checkpoint *c = &ckpts[k];
+	cpu = c->cpu;
+	snapshot_regions_load(c->dev);
+	instr_count = c->count;
+	init_ddr3();
+
+	arm_cow();
+	reverse_next = c->count + interval;
+}
+
+/* the latest checkpoint not after instruction `count' */
+static int find_ckpt(uint64_t count) {
+	int k = nr_ckpt - 1;
+	while(k > 0 && ckpts[k].count > count) { k --; }
+	return k;
+}
+
+/* Execute forward to instruction `end' quietly. With `last' given, it is
+ * set to the count after the last instruction which would stop at a
+ * breakpoint or a watchpoint.
+ */
+static void replay(uint64_t end, uint64_t *last) {
+	/* The tracers have seen these instructions. */
+	ITraceRecord *itrace = itrace_cur;
+	bool ftrace = ftrace_on, cg = callgrind_on, hashtrace = hashtrace_on;
+	uint32_t mtrace = mtrace_countdown;
+	itrace_cur = NULL;
+	ftrace_on = false;
+	callgrind_on = false;
+	hashtrace_on = false;
+	/* Nor are the counters of the work of NEMU advanced. */
+	perf_pause();
+
+	nemu_state = RUNNING;
+	while(instr_count < end) {
+		mtrace_countdown = -1;
+		cpu.eip += exec(cpu.eip);
+		instr_count ++;
+		if(last) {
+			bool hit = test_watchpoints();
+			if(bp_test(cpu.eip) || hit) { *last = instr_count; }
+		}
+	}
+	nemu_state = STOP;
+
+	perf_resume();
+	itrace_cur = itrace;
+	ftrace_on = ftrace;
+	callgrind_on = cg;
+	hashtrace_on = hashtrace;
+	mtrace_countdown = mtrace;
+	/* The block after the last branch replayed is not entered by cpu_exec(). */
+	fuzz_branch = false;
+}
+
+static void go_to(uint64_t count) {
+	restore_ckpt(find_ckpt(count));
+	sync_watchpoints();
+	replay(count, NULL);
+	sync_watchpoints();
+}
+
+static bool check_on() {
+	if(nr_ckpt == 0) {
+		printf("Reverse execution is off, turn it on with `reverse on'.\n");
+		return false;
+	}
+	if(instr_count == ckpts[0].count) {
+		printf("No more reverse-execution history.\n");
+		return false;
+	}
+	return true;
+}
+
+static void print_stop() {
+	printf("0x%08x at instruction %" PRIu64 "\n", cpu.eip, instr_count);
+}
+
+bool reverse_stepi(uint32_t n) {
+	if(!check_on()) { return false; }
+
+	uint64_t first = ckpts[0].count;
+	bool enough = (instr_count - first >= n);
+	go_to(enough ? instr_count - n : first);
+	if(!enough) {
+		printf("No more reverse-execution history.\n");
+	}
+	print_stop();
+	return enough;
+}
+
+/* Search the checkpoints backwards for the last stop before the current
+ * instruction. The stop found is reached by executing its instruction
+ * again, so that it is reported in the same way as running forward.
+ */
+bool reverse_continue() {
+	if(!check_on()) { return false; }
+
+	uint64_t end = instr_count - 1;
+	int k = find_ckpt(end);
+	while(1) {
+		uint64_t start = ckpts[k].count, last = 0;
+		restore_ckpt(k);
+		sync_watchpoints();
+		replay(end, &last);
+		if(last > 0) {
+			go_to(last - 1);
+			cpu_exec(1);
+			return true;
+		}
+		if(k == 0) { break; }
+		end = start;
+		k --;
+	}
+
+	go_to(ckpts[0].count);
+	printf("\nNo more reverse-execution history.\n");
+	print_stop();
+	return false;
+}
+
+void reverse_stop() {
+	while(nr_ckpt > 0) {
+		free_ckpt(&ckpts[-- nr_ckpt]);
+	}
+	memset(cow_bitmap, 0, sizeof(cow_bitmap));
+	reverse_next = -1ull;
+}
+
+/* `budget' is in MB. */
+void reverse_start(uint32_t n, uint32_t budget_mb) {
+	reverse_stop();
+	interval = n;
+	budget = (size_t)budget_mb << 20;
+	dev_size = snapshot_regions_size();
+	used = 0;
+	build_ram_bitmap();
+	reverse_checkpoint();
+}
+
+void reverse_reset() {
+	if(nr_ckpt == 0) { return; }
+	reverse_start(interval, budget >> 20);
+}
+
+void reverse_info() {
+	if(nr_ckpt == 0) {
+		printf("Reverse execution is off.\n");
+		return;
+	}
+
+	uint64_t nr_page = 0;
+	int i;
+	for(i = 0; i < nr_ckpt; i ++) {
+		nr_page += ckpts[i].nr_page;
+	}
+	printf("%d checkpoints every %u instructions, from instruction %" PRIu64 " to %" PRIu64 "\n",
+			nr_ckpt, interval, ckpts[0].count, ckpts[nr_ckpt - 1].count);
+	printf("%" PRIu64 " pages saved, %zu KB used of %zu KB\n", nr_page, used >> 10, budget >> 10);
+	printf("The current instruction is %" PRIu64 "\n", instr_count);
+}
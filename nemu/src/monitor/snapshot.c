@@ -0,0 +1,286 @@
+#include "nemu.h"
+#include "monitor/monitor.h"
+#include "monitor/snapshot.h"
+#include "monitor/watchpoint.h"
+#include "monitor/reverse.h"
+#include "memory/dirty.h"
+
+#include <zlib.h>
+#include <stdlib.h>
+
+#define SNAPSHOT_MAGIC "NEMUSNAP"
+#define SNAPSHOT_VERSION 2
+#define NR_REGION 64
+#define PAGE_END 0xffffffffu
+
+void init_ddr3();
+void reset_memory();
+
+typedef struct {
+	char magic[8];
+	uint32_t version;
+	uint32_t cpu_size;
+	uint64_t hw_mem_size;
+	uint32_t nr_region;
+} SnapshotHeader;
+
+typedef struct {
+	char name[32];
+	void *base;
+	size_t len;
+	snapshot_callback_t restore;
+} Region;
+
+static Region regions[NR_REGION];
+static int nr_region = 0;
+
+/* the snapshot file being saved or loaded */
+static gzFile snapshot_fp = NULL;
+
+void add_snapshot_region(const char *name, void *base, size_t len, snapshot_callback_t restore) {
+	assert(nr_region < NR_REGION);
+	Region *r = &regions[nr_region ++];
+	strncpy(r->name, name, sizeof(r->name) - 1);
+	r->base = base;
+	r->len = len;
+	r->restore = restore;
+}
+
+bool snapshot_write(const void *buf, size_t len) {
+	assert(snapshot_fp);
+	return len == 0 || gzwrite(snapshot_fp, buf, len) == len;
+}
+
+bool snapshot_read(void *buf, size_t len) {
+	assert(snapshot_fp);
+	return len == 0 || gzread(snapshot_fp, buf, len) == len;
+}
+
+size_t snapshot_regions_size() {
+	size_t size = 0;
+	int i;
+	for(i = 0; i < nr_region; i ++) {
+		size += regions[i].len;
+	}
+	return size;
+}
+
+void snapshot_regions_save(void *buf) {
+	int i;
+	for(i = 0; i < nr_region; i ++) {
+		memcpy(buf, regions[i].base, regions[i].len);
+		buf += regions[i].len;
+	}
+}
+
+void snapshot_regions_load(const void *buf) {
+	int i;
+	for(i = 0; i < nr_region; i ++) {
+		memcpy(regions[i].base, buf, regions[i].len);
+		buf += regions[i].len;
+	}
+	for(i = 0; i < nr_region; i ++) {
+		if(regions[i].restore) { regions[i].restore(); }
+	}
+}
+
+/* The state is written in the order: header, CPU, device regions,
+ * watchpoints, and the pages of memory. Only the pages written since the
+ * program was loaded are saved, each tagged with its page number, the
+ * others are mapped from the files of the program again when the snapshot
+ * is loaded. The whole file is compressed with zlib.
+ */
+static bool do_save() {
+	SnapshotHeader h = { SNAPSHOT_MAGIC, SNAPSHOT_VERSION, sizeof(cpu), hw_mem_size, nr_region };
+	if(!snapshot_write(&h, sizeof(h))) { return false; }
+	if(!snapshot_write(&cpu, sizeof(cpu))) { return false; }
+
+	int i;
+	for(i = 0; i < nr_region; i ++) {
+		uint64_t len = regions[i].len;
+		if(!snapshot_write(regions[i].name, sizeof(regions[i].name))) { return false; }
+		if(!snapshot_write(&len, sizeof(len))) { return false; }
+		if(!snapshot_write(regions[i].base, regions[i].len)) { return false; }
+	}
+
+	if(!save_wp()) { return false; }
+
+	int p;
+	for(p = changed_next(0); p >= 0; p = changed_next(p + 1)) {
+		uint32_t page = p;
+		if(pmem_map[page] != PMEM_RAM) { continue; }
+		if(!snapshot_write(&page, sizeof(page))) { return false; }
+		if(!snapshot_write(hwa_to_va(page << PMEM_PAGE_SHIFT), PMEM_PAGE_SIZE)) { return false; }
+	}
+
+	uint32_t page = PAGE_END;
+	return snapshot_write(&page, sizeof(page));
+}
+
+static bool check_header() {
+	SnapshotHeader h;
+	if(!snapshot_read(&h, sizeof(h)) || memcmp(h.magic, SNAPSHOT_MAGIC, sizeof(h.magic)) != 0 ||
+			h.version != SNAPSHOT_VERSION || h.cpu_size != sizeof(cpu)) {
+		printf("Not a snapshot of this version of NEMU\n");
+		return false;
+	}
+	if(h.hw_mem_size != hw_mem_size || h.nr_region != nr_region) {
+		printf("The snapshot is taken with a different machine configuration\n");
+		return false;
+	}
+	return true;
+}
+
+/* Read the CPU, the device regions and the watchpoints into temporaries. */
+static bool read_state(CPU_state *c, uint8_t *buf, WP **wps, uint32_t *nr_wp) {
+	if(!snapshot_read(c, sizeof(*c))) { return false; }
+
+	int i;
+	for(i = 0; i < nr_region; i ++) {
+		char name[sizeof(regions[i].name)];
+		uint64_t len;
+		if(!snapshot_read(name, sizeof(name))) { return false; }
+		if(!snapshot_read(&len, sizeof(len))) { return false; }
+		if(strncmp(name, regions[i].name, sizeof(name)) != 0 || len != regions[i].len) {
+			printf("The snapshot does not match device '%s'\n", regions[i].name);
+			return false;
+		}
+		if(!snapshot_read(buf, regions[i].len)) { return false; }
+		buf += regions[i].len;
+	}
+
+	return load_wp(wps, nr_wp);
+}
+
+/* The pages of memory read from a snapshot, before they are copied into
+ * guest memory.
+ */
+typedef struct {
+	uint32_t *no;
+	uint8_t *data;
+	uint32_t nr, size;
+} StagedPages;
+
+/* Read all the pages of memory into `pages'. The file should end right
+ * after them.
+ */
+static bool read_pages(StagedPages *pages) {
+	while(1) {
+		uint32_t page;
+		if(!snapshot_read(&page, sizeof(page))) { return false; }
+		if(page == PAGE_END) { break; }
+		if(page >= NR_PMEM_PAGE || pmem_map[page] != PMEM_RAM) { return false; }
+
+		if(pages->nr == pages->size) {
+			pages->size = (pages->size ? pages->size * 2 : 64);
+			pages->no = realloc(pages->no, pages->size * sizeof(uint32_t));
+			pages->data = realloc(pages->data, (size_t)pages->size * PMEM_PAGE_SIZE);
+			assert(pages->no && pages->data);
+		}
+		if(!snapshot_read(pages->data + (size_t)pages->nr * PMEM_PAGE_SIZE, PMEM_PAGE_SIZE)) { return false; }
+		pages->no[pages->nr ++] = page;
+	}
+
+	/* this also checks the CRC of the compressed stream */
+	uint8_t c;
+	return gzread(snapshot_fp, &c, 1) == 0 && gzeof(snapshot_fp);
+}
+
+/* The whole file is read and checked before anything is changed, so that
+ * a bad snapshot leaves the machine alone.
+ */
+static bool do_load() {
+	CPU_state c;
+	uint8_t *buf = malloc(snapshot_regions_size() + 1);
+	assert(buf);
+	WP *wps;
+	uint32_t nr_wp;
+	StagedPages pages = { NULL, NULL, 0, 0 };
+
+	bool ok = read_state(&c, buf, &wps, &nr_wp);
+	if(ok && !read_pages(&pages)) {
+		free(wps);
+		ok = false;
+	}
+	if(!ok) {
+		free(buf);
+		free(pages.no);
+		free(pages.data);
+		return false;
+	}
+
+	cpu = c;
+	int i;
+	uint8_t *p = buf;
+	for(i = 0; i < nr_region; i ++) {
+		memcpy(regions[i].base, p, regions[i].len);
+		p += regions[i].len;
+	}
+	free(buf);
+	restore_wp(wps, nr_wp);
+
+	/* The pages not in the snapshot are those of the program as loaded.
+	 * The pages copied are changed since then, as when they are saved,
+	 * their dirty bits are folded into the changed ones by dirty_clear().
+	 * They are not handed to reverse execution, whose history is reset.
+	 */
+	reset_memory();
+	uint32_t j;
+	for(j = 0; j < pages.nr; j ++) {
+		dirty_bitmap[pages.no[j] >> 6] |= 1ull << (pages.no[j] & 63);
+		memcpy(hwa_to_va(pages.no[j] << PMEM_PAGE_SHIFT), pages.data + (size_t)j * PMEM_PAGE_SIZE, PMEM_PAGE_SIZE);
+	}
+	free(pages.no);
+	free(pages.data);
+
+	init_ddr3();
+	dirty_clear();
+
+	for(i = 0; i < nr_region; i ++) {
+		if(regions[i].restore) { regions[i].restore(); }
+	}
+
+	/* The history of reverse execution starts again here. */
+	reverse_reset();
+	return true;
+}
+
+bool save_snapshot(const char *file) {
+	snapshot_fp = gzopen(file, "wb1");
+	if(snapshot_fp == NULL) {
+		printf("Can not open '%s'\n", file);
+		return false;
+	}
+
+	bool ok = do_save();
+	ok = (gzclose(snapshot_fp) == Z_OK) && ok;
+	snapshot_fp = NULL;
+	if(!ok) { printf("Can not write snapshot to '%s'\n", file); }
+	return ok;
+}
+
+bool load_snapshot(const char *file) {
+	snapshot_fp = gzopen(file, "rb");
+	if(snapshot_fp == NULL) {
+		printf("Can not open '%s'\n", file);
+		return false;
+	}
+
+	if(!check_header()) {
+		gzclose(snapshot_fp);
+		snapshot_fp = NULL;
+		return false;
+	}
+
+	bool ok = do_load();
+	gzclose(snapshot_fp);
+	snapshot_fp = NULL;
+	if(!ok) {
+		printf("Can not load snapshot from '%s'\n", file);
+		return false;
+	}
+
+	/* The program can run again even if the snapshot is taken after it ended. */
+	nemu_state = STOP;
+	return true;
+}
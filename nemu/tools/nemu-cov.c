@@ -0,0 +1,404 @@
+/* Turn the coverage written by the `coverage' command of NEMU into lcov
+ * data. Any number of coverage files can be given, from parallel runs for
+ * example, and the hits of a line or a function are the number of runs
+ * which have executed it.
+ *
+ * The coverage only marks where the basic blocks start. An instruction is
+ * executed if it is in a block marked, which runs from the mark to the
+ * next control-transfer instruction in the disassembly from objdump.
+ * The instructions are mapped to functions by the symbol table, and to
+ * source lines by the DWARF line information if the ELF file has it. The
+ * functions without line information are put under the ELF file itself.
+ */
+
+#include "monitor/coverage.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+/* Coverage, the number of runs which have marked each address */
+
+static uint16_t *runs[COVERAGE_NR_CHUNK];
+static int nr_run;
+
+static void load_coverage(const char *file) {
+	FILE *fp = fopen(file, "r");
+	if(fp == NULL) { perror(file); exit(1); }
+
+	CoverageHeader h;
+	if(fread(&h, sizeof(h), 1, fp) != 1 || memcmp(h.magic, COVERAGE_MAGIC, sizeof(h.magic)) != 0 ||
+			h.chunk_pow2 != COVERAGE_CHUNK_POW2) {
+		fprintf(stderr, "%s: not a coverage file of NEMU\n", file);
+		exit(1);
+	}
+
+	uint32_t i;
+	for(i = 0; i < h.nr_chunk; i ++) {
+		uint32_t idx;
+		uint8_t bits[COVERAGE_CHUNK_BYTES];
+		if(fread(&idx, sizeof(idx), 1, fp) != 1 || fread(bits, sizeof(bits), 1, fp) != 1 ||
+				idx >= COVERAGE_NR_CHUNK) {
+			fprintf(stderr, "%s: truncated coverage file\n", file);
+			exit(1);
+		}
+		if(runs[idx] == NULL) {
+			runs[idx] = calloc(1 << COVERAGE_CHUNK_POW2, sizeof(uint16_t));
+			assert(runs[idx]);
+		}
+		int j;
+		for(j = 0; j < (1 << COVERAGE_CHUNK_POW2); j ++) {
+			if((bits[j >> 3] >> (j & 7)) & 1) { runs[idx][j] ++; }
+		}
+	}
+	fclose(fp);
+	nr_run ++;
+}
+
+static int block_runs(uint32_t addr) {
+	uint16_t *c = runs[addr >> COVERAGE_CHUNK_POW2];
+	return (c ? c[addr & ((1 << COVERAGE_CHUNK_POW2) - 1)] : 0);
+}
+
+/* Functions */
+
+typedef struct {
+	uint32_t start, end;
+	const char *name;
+} Func;
+
+static Func *funcs;
+static int nr_func;
+
+static int cmp_func_addr(const void *a, const void *b) {
+	const Func *x = a, *y = b;
+	return (x->start > y->start) - (x->start < y->start);
+}
+
+static void load_symbols(const char *file) {
+	int fd = open(file, O_RDONLY);
+	if(fd < 0) { perror(file); exit(1); }
+	struct stat st;
+	fstat(fd, &st);
+	uint8_t *buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	assert(buf != MAP_FAILED);
+	close(fd);
+
+	Elf32_Ehdr *elf = (void *)buf;
+	if(memcmp(elf->e_ident, ELFMAG, SELFMAG) != 0 || elf->e_ident[EI_CLASS] != ELFCLASS32) {
+		fprintf(stderr, "%s: not an ELF32 file\n", file);
+		exit(1);
+	}
+
+	Elf32_Shdr *sh = (void *)(buf + elf->e_shoff);
+	int i;
+	for(i = 0; i < elf->e_shnum; i ++) {
+		if(sh[i].sh_type != SHT_SYMTAB) { continue; }
+		Elf32_Sym *sym = (void *)(buf + sh[i].sh_offset);
+		const char *str = (void *)(buf + sh[sh[i].sh_link].sh_offset);
+		int n = sh[i].sh_size / sizeof(Elf32_Sym), j;
+		funcs = calloc(n, sizeof(Func));
+		assert(funcs);
+		for(j = 0; j < n; j ++) {
+			if(ELF32_ST_TYPE(sym[j].st_info) == STT_FUNC) {
+				funcs[nr_func ++] = (Func) { sym[j].st_value, sym[j].st_value + sym[j].st_size, str + sym[j].st_name };
+			}
+		}
+	}
+	qsort(funcs, nr_func, sizeof(Func), cmp_func_addr);
+}
+
+/* Run objdump on `file' and pass each line of its output to `parse'. */
+static void run_objdump(const char *file, const char *arg, void (*parse)(char *)) {
+	int fd[2];
+	if(pipe(fd) != 0) { perror("pipe"); exit(1); }
+	pid_t pid = fork();
+	if(pid == 0) {
+		dup2(fd[1], STDOUT_FILENO);
+		close(fd[0]);
+		close(fd[1]);
+		execlp("objdump", "objdump", arg, "--wide", "--no-show-raw-insn", file, NULL);
+		_exit(127);
+	}
+	close(fd[1]);
+
+	FILE *fp = fdopen(fd[0], "r");
+	char line[1024];
+	while(fgets(line, sizeof(line), fp)) {
+		line[strcspn(line, "\n")] = '\0';
+		parse(line);
+	}
+	fclose(fp);
+	waitpid(pid, NULL, 0);
+}
+
+/* Instructions, from `objdump -d'. A block ends at an instruction which
+ * may not fall through to the next one.
+ */
+
+typedef struct {
+	uint32_t addr;
+	bool ends_block;
+	int runs;
+} Instr;
+
+static Instr *instrs;
+static size_t nr_instr, instr_cap;
+
+static bool is_control_transfer(const char *text) {
+	static const char *prefixes[] = { "rep ", "repz ", "repnz ", "repe ", "repne ", "bnd ", "notrack ", "data16 " };
+	static const char *mnemonics[] = { "j", "call", "lcall", "ret", "lret", "iret", "int", "loop", "hlt", "ud2", "(bad)" };
+	int i;
+	for(i = 0; i < sizeof(prefixes) / sizeof(prefixes[0]); i ++) {
+		size_t n = strlen(prefixes[i]);
+		if(strncmp(text, prefixes[i], n) == 0) {
+			text += n;
+			while(*text == ' ') { text ++; }
+			i = -1;
+		}
+	}
+	for(i = 0; i < sizeof(mnemonics) / sizeof(mnemonics[0]); i ++) {
+		if(strncmp(text, mnemonics[i], strlen(mnemonics[i])) == 0) { return true; }
+	}
+	return false;
+}
+
+static void parse_disasm(char *line) {
+	char *tab = strchr(line, '\t');
+	char *end;
+	uint32_t addr = strtoul(line, &end, 16);
+	if(tab == NULL || end == line || *end != ':') { return; }
+
+	if(nr_instr == instr_cap) {
+		instr_cap = (instr_cap ? instr_cap * 2 : 4096);
+		instrs = realloc(instrs, instr_cap * sizeof(Instr));
+		assert(instrs);
+	}
+	instrs[nr_instr ++] = (Instr) { addr, is_control_transfer(tab + 1), 0 };
+}
+
+static int cmp_instr(const void *a, const void *b) {
+	const Instr *x = a, *y = b;
+	return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+/* the index of the first instruction at or after `addr' */
+static size_t find_instr(uint32_t addr) {
+	size_t l = 0, r = nr_instr;
+	while(l < r) {
+		size_t m = (l + r) / 2;
+		if(instrs[m].addr < addr) { l = m + 1; }
+		else { r = m; }
+	}
+	return l;
+}
+
+static int runs_in(uint32_t start, uint32_t end) {
+	int n = 0;
+	size_t i;
+	for(i = find_instr(start); i < nr_instr && instrs[i].addr < end; i ++) {
+		if(instrs[i].runs > n) { n = instrs[i].runs; }
+	}
+	return n;
+}
+
+static bool has_instr(uint32_t start, uint32_t end) {
+	size_t i = find_instr(start);
+	return (i < nr_instr && instrs[i].addr < end);
+}
+
+static uint32_t nr_block;
+
+static void spread_blocks() {
+	size_t i, j;
+	for(i = 0; i < nr_instr; i ++) {
+		int n = block_runs(instrs[i].addr);
+		if(n == 0) { continue; }
+		nr_block ++;
+		for(j = i; j < nr_instr; j ++) {
+			if(instrs[j].runs < n) { instrs[j].runs = n; }
+			if(instrs[j].ends_block) { break; }
+		}
+	}
+}
+
+/* Source lines, from `objdump --dwarf=decodedline'. A row covers the
+ * addresses up to the next row, the last row of a sequence has no line.
+ */
+
+typedef struct {
+	uint32_t addr;
+	int line;
+	const char *file;
+} Row;
+
+static Row *rows;
+static size_t nr_row, row_cap;
+static char *cu_file;
+
+static const char *intern(const char *s) {
+	static char **names;
+	static int nr_name;
+	int i;
+	for(i = 0; i < nr_name; i ++) {
+		if(strcmp(names[i], s) == 0) { return names[i]; }
+	}
+	names = realloc(names, (nr_name + 1) * sizeof(char *));
+	assert(names);
+	return names[nr_name ++] = strdup(s);
+}
+
+static void parse_line(char *line) {
+	size_t len = strlen(line);
+	if(len > 1 && line[len - 1] == ':' && strchr(line, '\t') == NULL &&
+			(strncmp(line, "CU: ", 4) == 0 || strchr(line, ' ') == NULL)) {
+		line[len - 1] = '\0';
+		free(cu_file);
+		cu_file = strdup(strncmp(line, "CU: ", 4) == 0 ? line + 4 : line);
+		return;
+	}
+
+	char name[512], lineno[32], addr[32];
+	if(sscanf(line, "%511s %31s %31s", name, lineno, addr) != 3 || strncmp(addr, "0x", 2) != 0) { return; }
+
+	/* The rows only give the base name of the compilation unit. */
+	const char *file = name;
+	if(cu_file) {
+		const char *base = strrchr(cu_file, '/');
+		if(strcmp(base ? base + 1 : cu_file, name) == 0) { file = cu_file; }
+	}
+
+	if(nr_row == row_cap) {
+		row_cap = (row_cap ? row_cap * 2 : 4096);
+		rows = realloc(rows, row_cap * sizeof(Row));
+		assert(rows);
+	}
+	rows[nr_row ++] = (Row) { strtoul(addr, NULL, 16), (lineno[0] == '-' ? 0 : atoi(lineno)), intern(file) };
+}
+
+static const Row *find_row(uint32_t addr) {
+	size_t i;
+	for(i = 0; i + 1 < nr_row; i ++) {
+		if(rows[i].line > 0 && rows[i].addr <= addr && addr < rows[i + 1].addr) { return &rows[i]; }
+	}
+	return NULL;
+}
+
+/* Output */
+
+typedef struct {
+	const char *file;
+	int line;
+	const char *name;
+	int runs;
+} Entry;
+
+static int cmp_entry(const void *a, const void *b) {
+	const Entry *x = a, *y = b;
+	int c = strcmp(x->file, y->file);
+	if(c != 0) { return c; }
+	if(x->line != y->line) { return (x->line > y->line) - (x->line < y->line); }
+	return (x->name && y->name ? strcmp(x->name, y->name) : 0);
+}
+
+static void print_lcov(const char *elf_file, const char *test) {
+	Entry *fn = calloc(nr_func + 1, sizeof(Entry));
+	Entry *da = calloc(nr_row + 1, sizeof(Entry));
+	assert(fn && da);
+	size_t nr_fn = 0, nr_da = 0, i, j;
+
+	for(i = 0; i < nr_func; i ++) {
+		Func *f = &funcs[i];
+		if(i > 0 && f->start == funcs[i - 1].start) { continue; }
+		uint32_t end = (f->end > f->start ? f->end : f->start + 1);
+		if(!has_instr(f->start, end)) { continue; }
+		const Row *r = find_row(f->start);
+		fn[nr_fn ++] = (Entry) { (r ? r->file : elf_file), (r ? r->line : 0), f->name, runs_in(f->start, end) };
+	}
+
+	for(i = 0; i + 1 < nr_row; i ++) {
+		if(rows[i].line == 0 || !has_instr(rows[i].addr, rows[i + 1].addr)) { continue; }
+		da[nr_da ++] = (Entry) { rows[i].file, rows[i].line, NULL, runs_in(rows[i].addr, rows[i + 1].addr) };
+	}
+
+	/* The rows of a line are merged, and the sentinels end the last file. */
+	qsort(fn, nr_fn, sizeof(Entry), cmp_entry);
+	qsort(da, nr_da, sizeof(Entry), cmp_entry);
+	fn[nr_fn] = (Entry) { "", 0, NULL, 0 };
+	da[nr_da] = (Entry) { "", 0, NULL, 0 };
+
+	int fn_hit = 0, line_hit = 0, nr_line = 0;
+	size_t f = 0, d = 0;
+	while(f < nr_fn || d < nr_da) {
+		const char *file = (f < nr_fn && (d == nr_da || strcmp(fn[f].file, da[d].file) <= 0) ? fn[f].file : da[d].file);
+		printf("TN:%s\nSF:%s\n", test, file);
+
+		int nf = 0, hf = 0, nl = 0, hl = 0;
+		for(j = f; j < nr_fn && strcmp(fn[j].file, file) == 0; j ++) {
+			printf("FN:%d,%s\n", fn[j].line, fn[j].name);
+		}
+		for(; f < j; f ++) {
+			printf("FNDA:%d,%s\n", fn[f].runs, fn[f].name);
+			nf ++;
+			if(fn[f].runs) { hf ++; }
+		}
+		printf("FNF:%d\nFNH:%d\n", nf, hf);
+
+		for(; d < nr_da && strcmp(da[d].file, file) == 0; d ++) {
+			if(da[d + 1].line == da[d].line && strcmp(da[d + 1].file, file) == 0) {
+				if(da[d + 1].runs < da[d].runs) { da[d + 1].runs = da[d].runs; }
+				continue;
+			}
+			printf("DA:%d,%d\n", da[d].line, da[d].runs);
+			nl ++;
+			if(da[d].runs) { hl ++; }
+		}
+		printf("LF:%d\nLH:%d\nend_of_record\n", nl, hl);
+
+		fn_hit += hf;
+		line_hit += hl;
+		nr_line += nl;
+	}
+
+	fprintf(stderr, "%d runs, %u basic blocks covered, functions %d/%zu, lines %d/%d\n",
+			nr_run, nr_block, fn_hit, nr_fn, line_hit, nr_line);
+	free(fn);
+	free(da);
+}
+
+int main(int argc, char *argv[]) {
+	const char *test = "";
+	int o;
+	while((o = getopt(argc, argv, "t:")) != -1) {
+		switch(o) {
+			case 't': test = optarg; break;
+			default: goto usage;
+		}
+	}
+	if(argc - optind < 2) { goto usage; }
+
+	const char *elf_file = argv[optind];
+	int i;
+	for(i = optind + 1; i < argc; i ++) {
+		load_coverage(argv[i]);
+	}
+
+	load_symbols(elf_file);
+	run_objdump(elf_file, "-d", parse_disasm);
+	qsort(instrs, nr_instr, sizeof(Instr), cmp_instr);
+	run_objdump(elf_file, "--dwarf=decodedline", parse_line);
+
+	spread_blocks();
+	print_lcov(elf_file, test);
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-t NAME] ELF COVERAGE...\n"
+			"  -t  the name of the test in the lcov data\n"
+			"The lcov data is written to the standard output.\n", argv[0]);
+	return 1;
+}
@@ -0,0 +1,489 @@
+/* Find the first instruction where two runs of NEMU diverge, for example
+ * the runs of two builds, or of one build with two sets of options.
+ *
+ * Given two commands, both are run in batch mode with a hash trace of the
+ * state every N instructions. The first record which differs brackets the
+ * divergence, and only that interval is run again with the instruction
+ * trace, which is compared instruction by instruction: eip, the general
+ * registers, eflags and the memory writes. The runs must be deterministic,
+ * with the events of devices replayed from a file if there are any.
+ *
+ * Two hash traces, or two instruction traces, written before can also be
+ * compared directly.
+ */
+
+#include "monitor/hashtrace.h"
+#include "monitor/itrace.h"
+
+#include <stdlib.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+#define NR_CONTEXT 4
+
+static const char *regs[] = { "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi" };
+
+static void *map_file(const char *file, size_t *size) {
+	int fd = open(file, O_RDONLY);
+	if(fd < 0) { perror(file); exit(2); }
+	struct stat st;
+	fstat(fd, &st);
+	void *p = (st.st_size > 0 ? mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0) : MAP_FAILED);
+	close(fd);
+	if(p == MAP_FAILED) {
+		fprintf(stderr, "%s: can not map\n", file);
+		exit(2);
+	}
+	*size = st.st_size;
+	return p;
+}
+
+static bool has_magic(const char *file, const char *magic) {
+	char buf[8];
+	FILE *fp = fopen(file, "r");
+	if(fp == NULL) { perror(file); exit(2); }
+	bool ok = (fread(buf, sizeof(buf), 1, fp) == 1 && memcmp(buf, magic, sizeof(buf)) == 0);
+	fclose(fp);
+	return ok;
+}
+
+/* Hash traces */
+
+typedef struct {
+	const char *file;
+	HashTraceHeader *header;
+	HashTraceRecord *rec;
+	uint64_t nr;
+} HashTrace;
+
+static void load_hash(HashTrace *t, const char *file) {
+	size_t size;
+	t->file = file;
+	t->header = map_file(file, &size);
+	if(size < sizeof(HashTraceHeader) || memcmp(t->header->magic, HASHTRACE_MAGIC, sizeof(t->header->magic)) != 0 ||
+			t->header->record_size != sizeof(HashTraceRecord)) {
+		fprintf(stderr, "%s: not a hash trace of NEMU\n", file);
+		exit(2);
+	}
+	t->rec = (void *)(t->header + 1);
+	t->nr = (size - sizeof(HashTraceHeader)) / sizeof(HashTraceRecord);
+}
+
+/* Find the interval [start, end) of instructions where the runs diverge.
+ * If a run is a prefix of the other, `end' is where the longer one goes.
+ */
+static bool compare_hash(HashTrace *a, HashTrace *b, uint64_t *start, uint64_t *end) {
+	if(a->header->interval != b->header->interval) {
+		fprintf(stderr, "the hash traces have different intervals\n");
+		exit(2);
+	}
+
+	uint64_t i;
+	*start = 0;
+	for(i = 0; i < a->nr && i < b->nr; i ++) {
+		HashTraceRecord *ra = &a->rec[i], *rb = &b->rec[i];
+		if(ra->count != rb->count || ra->hash != rb->hash) {
+			*end = (ra->count > rb->count ? ra->count : rb->count);
+			return true;
+		}
+		*start = ra->count;
+	}
+	if(a->nr == b->nr) { return false; }
+	*end = (a->nr > b->nr ? a : b)->rec[i].count;
+	return true;
+}
+
+/* Instruction traces, the records are indexed by the number of the
+ * instruction in the whole run.
+ */
+
+typedef struct {
+	const char *file;
+	ITraceHeader *header;
+	ITraceRecord *ring;
+	uint64_t first, base, end;
+} ITrace;
+
+static void load_itrace(ITrace *t, const char *file) {
+	size_t size;
+	t->file = file;
+	t->header = map_file(file, &size);
+	if(size < sizeof(ITraceHeader) || memcmp(t->header->magic, ITRACE_MAGIC, sizeof(t->header->magic)) != 0 ||
+			t->header->record_size != sizeof(ITraceRecord) ||
+			size < sizeof(ITraceHeader) + (uint64_t)t->header->nr_record * sizeof(ITraceRecord)) {
+		fprintf(stderr, "%s: not an instruction trace of NEMU\n", file);
+		exit(2);
+	}
+	t->ring = (void *)(t->header + 1);
+
+	uint64_t nr = t->header->count;
+	t->first = 0;
+	if(nr > t->header->nr_record) {
+		nr = t->header->nr_record;
+		t->first = t->header->count % t->header->nr_record;
+	}
+	t->end = t->header->count;
+	t->base = t->end - nr;
+}
+
+static ITraceRecord *record(ITrace *t, uint64_t k) {
+	return &t->ring[(t->first + k - t->base) % t->header->nr_record];
+}
+
+/* Functions and disassembly of the ELF file */
+
+typedef struct {
+	uint32_t start, end;
+	const char *name;
+} Func;
+
+static Func *funcs;
+static int nr_func;
+
+static int cmp_func_addr(const void *a, const void *b) {
+	const Func *x = a, *y = b;
+	return (x->start > y->start) - (x->start < y->start);
+}
+
+static void load_symbols(const char *file) {
+	size_t size;
+	uint8_t *buf = map_file(file, &size);
+	Elf32_Ehdr *elf = (void *)buf;
+	if(memcmp(elf->e_ident, ELFMAG, SELFMAG) != 0 || elf->e_ident[EI_CLASS] != ELFCLASS32) {
+		fprintf(stderr, "%s: not an ELF32 file\n", file);
+		exit(2);
+	}
+
+	Elf32_Shdr *sh = (void *)(buf + elf->e_shoff);
+	int i;
+	for(i = 0; i < elf->e_shnum; i ++) {
+		if(sh[i].sh_type != SHT_SYMTAB) { continue; }
+		Elf32_Sym *sym = (void *)(buf + sh[i].sh_offset);
+		const char *str = (void *)(buf + sh[sh[i].sh_link].sh_offset);
+		int n = sh[i].sh_size / sizeof(Elf32_Sym), j;
+		funcs = calloc(n, sizeof(Func));
+		assert(funcs);
+		for(j = 0; j < n; j ++) {
+			if(ELF32_ST_TYPE(sym[j].st_info) == STT_FUNC) {
+				funcs[nr_func ++] = (Func) { sym[j].st_value, sym[j].st_value + sym[j].st_size, str + sym[j].st_name };
+			}
+		}
+	}
+	qsort(funcs, nr_func, sizeof(Func), cmp_func_addr);
+}
+
+static Func *find_func(uint32_t eip) {
+	int l = 0, r = nr_func - 1;
+	while(l <= r) {
+		int m = (l + r) / 2;
+		if(eip < funcs[m].start) { r = m - 1; }
+		else if(eip >= funcs[m].end) { l = m + 1; }
+		else { return &funcs[m]; }
+	}
+	return NULL;
+}
+
+typedef struct {
+	uint32_t addr;
+	char *text;
+} Disasm;
+
+static Disasm *disasm;
+static size_t nr_disasm;
+
+static int cmp_disasm(const void *a, const void *b) {
+	const Disasm *x = a, *y = b;
+	return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+static void load_disasm(const char *file) {
+	int fd[2];
+	if(pipe(fd) != 0) { perror("pipe"); exit(2); }
+	pid_t pid = fork();
+	if(pid == 0) {
+		dup2(fd[1], STDOUT_FILENO);
+		close(fd[0]);
+		close(fd[1]);
+		execlp("objdump", "objdump", "-d", "--no-show-raw-insn", file, NULL);
+		_exit(127);
+	}
+	close(fd[1]);
+
+	FILE *fp = fdopen(fd[0], "r");
+	size_t cap = 0;
+	char line[512];
+	while(fgets(line, sizeof(line), fp)) {
+		char *tab = strchr(line, '\t');
+		char *end;
+		uint32_t addr = strtoul(line, &end, 16);
+		if(tab == NULL || end == line || *end != ':') { continue; }
+
+		tab[strcspn(tab, "\n")] = '\0';
+		if(nr_disasm == cap) {
+			cap = (cap ? cap * 2 : 4096);
+			disasm = realloc(disasm, cap * sizeof(Disasm));
+			assert(disasm);
+		}
+		disasm[nr_disasm ++] = (Disasm) { addr, strdup(tab + 1) };
+	}
+	fclose(fp);
+	waitpid(pid, NULL, 0);
+	qsort(disasm, nr_disasm, sizeof(Disasm), cmp_disasm);
+}
+
+static const char *find_disasm(uint32_t addr) {
+	size_t l = 0, r = nr_disasm;
+	while(l < r) {
+		size_t m = (l + r) / 2;
+		if(disasm[m].addr < addr) { l = m + 1; }
+		else { r = m; }
+	}
+	return (l < nr_disasm && disasm[l].addr == addr ? disasm[l].text : "");
+}
+
+/* Comparing instructions */
+
+enum { DIFF_EIP = 1, DIFF_GPR = 2, DIFF_EFLAGS = 0x200, DIFF_MEM = 0x400 };
+
+static uint32_t diff_record(ITraceRecord *a, ITraceRecord *b) {
+	uint32_t d = 0;
+	int j;
+	if(a->eip != b->eip) { d |= DIFF_EIP; }
+	for(j = 0; j < 8; j ++) {
+		if(a->gpr[j] != b->gpr[j]) { d |= DIFF_GPR << j; }
+	}
+	if(a->eflags != b->eflags) { d |= DIFF_EFLAGS; }
+	if(a->nr_mem != b->nr_mem) { d |= DIFF_MEM; }
+	for(j = 0; j < a->nr_mem && j < ITRACE_NR_MEM && !(d & DIFF_MEM); j ++) {
+		if(a->mem_addr[j] != b->mem_addr[j] || a->mem_len[j] != b->mem_len[j] ||
+				a->mem_data[j] != b->mem_data[j]) {
+			d |= DIFF_MEM;
+		}
+	}
+	return d;
+}
+
+static void print_instr(const char *tag, uint64_t k, ITraceRecord *r) {
+	printf("%s %10" PRIu64 "  %08x:", tag, k, r->eip);
+	Func *f = find_func(r->eip);
+	if(f) {
+		printf(" <%s+%u>", f->name, r->eip - f->start);
+	}
+	printf(" %s\n", find_disasm(r->eip));
+}
+
+static void print_diff(const char *tag, ITraceRecord *r, uint32_t d) {
+	printf("%s            ", tag);
+	int j;
+	if(d & DIFF_EIP) { printf("  eip=0x%08x", r->eip); }
+	for(j = 0; j < 8; j ++) {
+		if(d & (DIFF_GPR << j)) { printf("  %s=0x%x", regs[j], r->gpr[j]); }
+	}
+	if(d & DIFF_EFLAGS) { printf("  eflags=0x%x", r->eflags); }
+	if(d & DIFF_MEM) {
+		for(j = 0; j < r->nr_mem && j < ITRACE_NR_MEM; j ++) {
+			printf("  [0x%08x]%d=0x%x", r->mem_addr[j], r->mem_len[j], r->mem_data[j]);
+		}
+		if(r->nr_mem == 0) { printf("  (no writes)"); }
+		else if(r->nr_mem > ITRACE_NR_MEM) { printf("  (+%d writes)", r->nr_mem - ITRACE_NR_MEM); }
+	}
+	printf("\n");
+}
+
+/* Return true if the runs diverge in the instructions traced by both. */
+static bool compare_itrace(ITrace *a, ITrace *b) {
+	uint64_t start = (a->base > b->base ? a->base : b->base);
+	uint64_t end = (a->end < b->end ? a->end : b->end);
+	uint64_t k;
+	for(k = start; k < end; k ++) {
+		uint32_t d = diff_record(record(a, k), record(b, k));
+		if(d == 0) { continue; }
+
+		printf("The runs diverge at instruction %" PRIu64 ":\n", k);
+		uint64_t c = (k - start > NR_CONTEXT ? k - NR_CONTEXT : start);
+		for(; c < k; c ++) {
+			print_instr(" ", c, record(a, c));
+		}
+		print_instr("A", k, record(a, k));
+		print_diff("A", record(a, k), d);
+		print_instr("B", k, record(b, k));
+		print_diff("B", record(b, k), d);
+		return true;
+	}
+
+	if(a->end != b->end) {
+		ITrace *s = (a->end < b->end ? a : b);
+		printf("The runs agree until run %s stops after %" PRIu64 " instructions, the other goes on:\n",
+				(s == a ? "A" : "B"), s->end);
+		ITrace *l = (s == a ? b : a);
+		if(s->end >= l->base && s->end < l->end) {
+			print_instr(s == a ? "B" : "A", s->end, record(l, s->end));
+		}
+		return true;
+	}
+	return false;
+}
+
+/* Running the commands */
+
+static pid_t spawn(const char *cmd, const char *extra, const char *log) {
+	char *line = malloc(strlen(cmd) + strlen(extra) + strlen(log) + 32);
+	assert(line);
+	sprintf(line, "%s %s > %s 2>&1", cmd, extra, log);
+	pid_t pid = fork();
+	if(pid == 0) {
+		execl("/bin/sh", "sh", "-c", line, NULL);
+		_exit(127);
+	}
+	free(line);
+	return pid;
+}
+
+/* Run both commands with their options, the last of which is the file
+ * `DIR/a.NAME' or `DIR/b.NAME', and wait for them.
+ */
+static void run_both(const char *cmd[2], const char *dir, char opts[2][256], const char *name) {
+	pid_t pid[2];
+	int i;
+	for(i = 0; i < 2; i ++) {
+		char extra[1024], log[1024];
+		snprintf(extra, sizeof(extra), "%s %s/%c.%s", opts[i], dir, 'a' + i, name);
+		snprintf(log, sizeof(log), "%s/%c.%s.log", dir, 'a' + i, name);
+		unlink(extra + strlen(opts[i]) + 1);
+		pid[i] = spawn(cmd[i], extra, log);
+	}
+	for(i = 0; i < 2; i ++) {
+		waitpid(pid[i], NULL, 0);
+	}
+
+	for(i = 0; i < 2; i ++) {
+		char file[1024];
+		snprintf(file, sizeof(file), "%s/%c.%s", dir, 'a' + i, name);
+		if(access(file, R_OK) != 0) {
+			fprintf(stderr, "run %c failed, see '%s.log'\n", 'A' + i, file);
+			exit(2);
+		}
+	}
+}
+
+static int run_and_compare(const char *cmd[2], uint32_t interval, const char *dir) {
+	char file[2][1024], opts[2][256];
+	HashTrace h[2];
+	int i;
+	for(i = 0; i < 2; i ++) {
+		snprintf(opts[i], sizeof(opts[i]), "-b --hash-interval %u --hash-trace", interval);
+	}
+	run_both(cmd, dir, opts, "hash");
+	for(i = 0; i < 2; i ++) {
+		snprintf(file[i], sizeof(file[i]), "%s/%c.hash", dir, 'a' + i);
+		load_hash(&h[i], file[i]);
+	}
+
+	uint64_t start, end;
+	if(!compare_hash(&h[0], &h[1], &start, &end)) {
+		printf("The runs agree on all %" PRIu64 " instructions\n", h[0].nr ? h[0].rec[h[0].nr - 1].count : 0);
+		return 0;
+	}
+	printf("The runs agree on the first %" PRIu64 " instructions, and diverge before instruction %" PRIu64 "\n",
+			start, end);
+
+	/* Only the interval is kept in the instruction traces. A run which has
+	 * stopped before the end of it stops at the same point again.
+	 */
+	for(i = 0; i < 2; i ++) {
+		uint64_t last = (h[i].nr ? h[i].rec[h[i].nr - 1].count : 0);
+		uint64_t max = (last < end ? last : end);
+		snprintf(opts[i], sizeof(opts[i]), "-b --max-insns %" PRIu64 " --itrace-len %" PRIu64 " --itrace",
+				max, (max > start ? max - start : 1));
+	}
+	run_both(cmd, dir, opts, "itrace");
+
+	ITrace t[2];
+	for(i = 0; i < 2; i ++) {
+		snprintf(file[i], sizeof(file[i]), "%s/%c.itrace", dir, 'a' + i);
+		load_itrace(&t[i], file[i]);
+	}
+	if(!compare_itrace(&t[0], &t[1])) {
+		printf("The difference is not found in the instructions, it may be in memory written by devices\n");
+	}
+	printf("The traces are kept in '%s'\n", dir);
+	return 1;
+}
+
+int main(int argc, char *argv[]) {
+	const char *cmd[2] = { NULL, NULL };
+	const char *elf_file = NULL;
+	const char *dir = NULL;
+	uint32_t interval = HASHTRACE_DEFAULT_INTERVAL;
+	int o;
+	while((o = getopt(argc, argv, "a:b:n:e:d:")) != -1) {
+		switch(o) {
+			case 'a': cmd[0] = optarg; break;
+			case 'b': cmd[1] = optarg; break;
+			case 'n': interval = strtoul(optarg, NULL, 0); break;
+			case 'e': elf_file = optarg; break;
+			case 'd': dir = optarg; break;
+			default: goto usage;
+		}
+	}
+	if(interval == 0) { goto usage; }
+
+	if(elf_file) {
+		load_symbols(elf_file);
+		load_disasm(elf_file);
+	}
+
+	if(cmd[0] && cmd[1] && optind == argc) {
+		char tmp[] = "/tmp/nemu-diff.XXXXXX";
+		if(dir == NULL) {
+			dir = mkdtemp(tmp);
+			if(dir == NULL) { perror("mkdtemp"); return 2; }
+		}
+		else if(mkdir(dir, 0755) != 0 && errno != EEXIST) {
+			perror(dir);
+			return 2;
+		}
+		return run_and_compare(cmd, interval, dir);
+	}
+
+	if(cmd[0] || cmd[1] || optind != argc - 2) { goto usage; }
+	if(has_magic(argv[optind], HASHTRACE_MAGIC)) {
+		HashTrace h[2];
+		load_hash(&h[0], argv[optind]);
+		load_hash(&h[1], argv[optind + 1]);
+		uint64_t start, end;
+		if(!compare_hash(&h[0], &h[1], &start, &end)) {
+			printf("The runs agree\n");
+			return 0;
+		}
+		printf("The runs agree on the first %" PRIu64 " instructions, and diverge before instruction %" PRIu64 "\n",
+				start, end);
+		return 1;
+	}
+
+	ITrace t[2];
+	load_itrace(&t[0], argv[optind]);
+	load_itrace(&t[1], argv[optind + 1]);
+	if(!compare_itrace(&t[0], &t[1])) {
+		printf("The runs agree on the instructions traced by both\n");
+		return 0;
+	}
+	return 1;
+
+usage:
+	fprintf(stderr, "usage: %s [-n N] [-e ELF] [-d DIR] -a COMMAND -b COMMAND\n"
+			"       %s [-e ELF] TRACE TRACE\n"
+			"  -a, -b  the commands to run NEMU, in batch mode with the traces added\n"
+			"  -n      hash the state every N instructions\n"
+			"  -e      the ELF file of the program for the symbols and the disassembly\n"
+			"  -d      the directory for the traces, a new one in /tmp by default\n"
+			"The traces are both hash traces or both instruction traces. The exit status\n"
+			"is 0 if the runs agree, 1 if they diverge and 2 on errors.\n", argv[0], argv[0]);
+	return 2;
+}
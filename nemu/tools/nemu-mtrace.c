@@ -0,0 +1,334 @@
+/* Offline analysis of the sampled memory access trace written by the
+ * `mtrace' command of NEMU. It reports
+ *   - the reuse distance histogram of cache lines,
+ *   - the hottest pages,
+ *   - the footprint of each function, if the ELF file is given.
+ * The reuse distance is measured between the sampled accesses, multiply
+ * it by the sampling rate to estimate the real distance.
+ */
+
+#include "memory/mtrace.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define LINE_SHIFT 6
+#define PAGE_SHIFT 12
+#define NR_BUCKET 33
+#define NR_TOP 20
+
+/* open addressing hash map from 64-bit keys to 32-bit values */
+typedef struct {
+	uint64_t *key;
+	uint32_t *val;
+	size_t size, nr;
+} HashMap;
+
+#define EMPTY_KEY (~0ull)
+
+static void map_init(HashMap *m) {
+	m->size = 1024;
+	m->nr = 0;
+	m->key = malloc(m->size * sizeof(uint64_t));
+	m->val = malloc(m->size * sizeof(uint32_t));
+	assert(m->key && m->val);
+	memset(m->key, 0xff, m->size * sizeof(uint64_t));
+}
+
+static size_t map_slot(HashMap *m, uint64_t key) {
+	size_t i = (key * 0x9e3779b97f4a7c15ull) >> 20;
+	while(1) {
+		i &= m->size - 1;
+		if(m->key[i] == key || m->key[i] == EMPTY_KEY) { return i; }
+		i ++;
+	}
+}
+
+/* Return the value of `key', inserting it with value `init' if it is absent. */
+static uint32_t *map_get(HashMap *m, uint64_t key, uint32_t init) {
+	size_t i = map_slot(m, key);
+	if(m->key[i] == EMPTY_KEY) {
+		if((m->nr + 1) * 2 > m->size) {
+			HashMap old = *m;
+			m->size *= 2;
+			m->nr = 0;
+			m->key = malloc(m->size * sizeof(uint64_t));
+			m->val = malloc(m->size * sizeof(uint32_t));
+			assert(m->key && m->val);
+			memset(m->key, 0xff, m->size * sizeof(uint64_t));
+			size_t j;
+			for(j = 0; j < old.size; j ++) {
+				if(old.key[j] != EMPTY_KEY) {
+					*map_get(m, old.key[j], 0) = old.val[j];
+				}
+			}
+			free(old.key);
+			free(old.val);
+			i = map_slot(m, key);
+		}
+		m->key[i] = key;
+		m->val[i] = init;
+		m->nr ++;
+	}
+	return &m->val[i];
+}
+
+static MTraceRecord *rec;
+static size_t nr_rec;
+static uint32_t rate;
+static bool with_fetch = false;
+
+static void load_trace(const char *file) {
+	int fd = open(file, O_RDONLY);
+	if(fd < 0) { perror(file); exit(1); }
+	struct stat st;
+	fstat(fd, &st);
+
+	MTraceHeader *h = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(h == MAP_FAILED || st.st_size < sizeof(*h) || memcmp(h->magic, MTRACE_MAGIC, sizeof(h->magic)) != 0) {
+		fprintf(stderr, "%s: not a memory trace of NEMU\n", file);
+		exit(1);
+	}
+	close(fd);
+
+	rate = h->rate;
+	rec = (void *)(h + 1);
+	nr_rec = (st.st_size - sizeof(*h)) / sizeof(MTraceRecord);
+}
+
+static bool selected(MTraceRecord *r) {
+	return with_fetch || r->type != MTRACE_FETCH;
+}
+
+static void summary() {
+	size_t count[3] = { 0 };
+	size_t i;
+	for(i = 0; i < nr_rec; i ++) {
+		if(rec[i].type < 3) { count[rec[i].type] ++; }
+	}
+	printf("%zu samples, 1 of every %u accesses\n", nr_rec, rate);
+	printf("  read  %zu\n  write %zu\n  fetch %zu%s\n\n", count[MTRACE_READ], count[MTRACE_WRITE],
+			count[MTRACE_FETCH], (with_fetch ? "" : " (excluded below, use -x to include)"));
+}
+
+/* Fenwick tree over the time of samples, a time is marked if it is the
+ * last access to some line. The reuse distance of an access is the number
+ * of marks between it and the previous access to the same line.
+ */
+static uint32_t *bit;
+
+static void bit_add(size_t i, int v) {
+	for(i ++; i <= nr_rec; i += i & -i) { bit[i] += v; }
+}
+
+static uint32_t bit_sum(size_t i) {
+	uint32_t s = 0;
+	for(i ++; i > 0; i -= i & -i) { s += bit[i]; }
+	return s;
+}
+
+static void reuse_distance() {
+	uint64_t hist[NR_BUCKET] = { 0 }, cold = 0;
+	bit = calloc(nr_rec + 1, sizeof(uint32_t));
+	assert(bit);
+
+	HashMap last;
+	map_init(&last);
+	size_t t;
+	for(t = 0; t < nr_rec; t ++) {
+		if(!selected(&rec[t])) { continue; }
+		uint32_t *p = map_get(&last, rec[t].addr >> LINE_SHIFT, -1);
+		if(*p == (uint32_t)-1) {
+			cold ++;
+		}
+		else {
+			uint32_t d = bit_sum(t) - bit_sum(*p);
+			hist[d == 0 ? 0 : 64 - __builtin_clzll(d)] ++;
+			bit_add(*p, -1);
+		}
+		bit_add(t, 1);
+		*p = t;
+	}
+
+	printf("reuse distance of %d-byte lines (in distinct sampled lines)\n", 1 << LINE_SHIFT);
+	printf("  %-24s %" PRIu64 "\n", "cold", cold);
+	int i;
+	for(i = 0; i < NR_BUCKET; i ++) {
+		if(hist[i] == 0) { continue; }
+		char range[32];
+		if(i == 0) { sprintf(range, "0"); }
+		else { sprintf(range, "[%llu, %llu)", 1ull << (i - 1), 1ull << i); }
+		printf("  %-24s %" PRIu64 "\n", range, hist[i]);
+	}
+	printf("%zu distinct lines\n\n", last.nr);
+	free(bit);
+}
+
+typedef struct {
+	uint32_t page;
+	uint32_t read, write;
+} PageHeat;
+
+static int cmp_heat(const void *a, const void *b) {
+	const PageHeat *x = a, *y = b;
+	uint32_t sx = x->read + x->write, sy = y->read + y->write;
+	return (sx < sy) - (sx > sy);
+}
+
+static void page_heat() {
+	HashMap idx;
+	map_init(&idx);
+	PageHeat *heat = NULL;
+	size_t nr = 0, cap = 0, i;
+	for(i = 0; i < nr_rec; i ++) {
+		if(!selected(&rec[i])) { continue; }
+		uint32_t *p = map_get(&idx, rec[i].addr >> PAGE_SHIFT, -1);
+		if(*p == (uint32_t)-1) {
+			if(nr == cap) {
+				cap = (cap ? cap * 2 : 1024);
+				heat = realloc(heat, cap * sizeof(PageHeat));
+				assert(heat);
+			}
+			heat[nr] = (PageHeat) { rec[i].addr >> PAGE_SHIFT, 0, 0 };
+			*p = nr ++;
+		}
+		if(rec[i].type == MTRACE_WRITE) { heat[*p].write ++; }
+		else { heat[*p].read ++; }
+	}
+
+	qsort(heat, nr, sizeof(PageHeat), cmp_heat);
+	printf("hottest pages (%zu touched)\n", nr);
+	printf("  %-12s %10s %10s  \n", "page", "read", "write");
+	uint32_t max = (nr > 0 ? heat[0].read + heat[0].write : 1);
+	for(i = 0; i < nr && i < NR_TOP; i ++) {
+		int bar = (uint64_t)(heat[i].read + heat[i].write) * 40 / max;
+		printf("  0x%08x   %10u %10u  %.*s\n", heat[i].page << PAGE_SHIFT, heat[i].read, heat[i].write,
+				bar, "########################################");
+	}
+	printf("\n");
+	free(heat);
+}
+
+typedef struct {
+	uint32_t start, end;
+	const char *name;
+	uint32_t samples, lines, pages;
+} Func;
+
+static Func *funcs;
+static int nr_func;
+
+static int cmp_func_addr(const void *a, const void *b) {
+	const Func *x = a, *y = b;
+	return (x->start > y->start) - (x->start < y->start);
+}
+
+static int cmp_func_samples(const void *a, const void *b) {
+	const Func *x = a, *y = b;
+	return (x->samples < y->samples) - (x->samples > y->samples);
+}
+
+static void load_symbols(const char *file) {
+	int fd = open(file, O_RDONLY);
+	if(fd < 0) { perror(file); exit(1); }
+	struct stat st;
+	fstat(fd, &st);
+	uint8_t *buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	assert(buf != MAP_FAILED);
+	close(fd);
+
+	Elf32_Ehdr *elf = (void *)buf;
+	if(memcmp(elf->e_ident, ELFMAG, SELFMAG) != 0 || elf->e_ident[EI_CLASS] != ELFCLASS32) {
+		fprintf(stderr, "%s: not an ELF32 file\n", file);
+		exit(1);
+	}
+
+	Elf32_Shdr *sh = (void *)(buf + elf->e_shoff);
+	int i;
+	for(i = 0; i < elf->e_shnum; i ++) {
+		if(sh[i].sh_type != SHT_SYMTAB) { continue; }
+		Elf32_Sym *sym = (void *)(buf + sh[i].sh_offset);
+		const char *str = (void *)(buf + sh[sh[i].sh_link].sh_offset);
+		int n = sh[i].sh_size / sizeof(Elf32_Sym), j;
+		funcs = calloc(n, sizeof(Func));
+		assert(funcs);
+		for(j = 0; j < n; j ++) {
+			if(ELF32_ST_TYPE(sym[j].st_info) == STT_FUNC) {
+				funcs[nr_func ++] = (Func) { sym[j].st_value, sym[j].st_value + sym[j].st_size, str + sym[j].st_name };
+			}
+		}
+	}
+	qsort(funcs, nr_func, sizeof(Func), cmp_func_addr);
+}
+
+static Func *find_func(uint32_t eip) {
+	int l = 0, r = nr_func - 1;
+	while(l <= r) {
+		int m = (l + r) / 2;
+		if(eip < funcs[m].start) { r = m - 1; }
+		else if(eip >= funcs[m].end) { l = m + 1; }
+		else { return &funcs[m]; }
+	}
+	return NULL;
+}
+
+static void footprint() {
+	HashMap lines, pages;
+	map_init(&lines);
+	map_init(&pages);
+	uint32_t unknown = 0;
+	size_t i;
+	for(i = 0; i < nr_rec; i ++) {
+		if(!selected(&rec[i])) { continue; }
+		Func *f = find_func(rec[i].eip);
+		if(f == NULL) { unknown ++; continue; }
+
+		uint64_t id = f - funcs;
+		f->samples ++;
+		uint32_t *p = map_get(&lines, id << 32 | rec[i].addr >> LINE_SHIFT, 0);
+		if((*p) ++ == 0) { f->lines ++; }
+		p = map_get(&pages, id << 32 | rec[i].addr >> PAGE_SHIFT, 0);
+		if((*p) ++ == 0) { f->pages ++; }
+	}
+
+	qsort(funcs, nr_func, sizeof(Func), cmp_func_samples);
+	printf("footprint of functions (in sampled accesses)\n");
+	printf("  %-24s %10s %10s %10s\n", "function", "samples", "lines", "pages");
+	int j;
+	for(j = 0; j < nr_func && funcs[j].samples > 0; j ++) {
+		printf("  %-24s %10u %10u %10u\n", funcs[j].name, funcs[j].samples, funcs[j].lines, funcs[j].pages);
+	}
+	if(unknown > 0) {
+		printf("  %-24s %10u\n", "??", unknown);
+	}
+}
+
+int main(int argc, char *argv[]) {
+	int o;
+	while((o = getopt(argc, argv, "x")) != -1) {
+		switch(o) {
+			case 'x': with_fetch = true; break;
+			default: goto usage;
+		}
+	}
+	if(optind != argc - 1 && optind != argc - 2) { goto usage; }
+
+	load_trace(argv[optind]);
+	summary();
+	reuse_distance();
+	page_heat();
+	if(optind == argc - 2) {
+		load_symbols(argv[optind + 1]);
+		footprint();
+	}
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-x] TRACE [ELF]\n  -x  include instruction fetches\n", argv[0]);
+	return 1;
+}
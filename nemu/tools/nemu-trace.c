@@ -0,0 +1,288 @@
+/* Print the instruction trace written by the `itrace' command of NEMU.
+ * Each instruction is shown with its raw bytes, the disassembly from
+ * objdump if the ELF file is given, the registers it changes and the
+ * memory it writes. The instructions can be selected by a range of eip,
+ * or by a function in the ELF file.
+ */
+
+#include "monitor/itrace.h"
+
+#include <stdlib.h>
+#include <inttypes.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <elf.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+
+static const char *regs[] = { "eax", "ecx", "edx", "ebx", "esp", "ebp", "esi", "edi" };
+
+static ITraceHeader *header;
+static ITraceRecord *ring;
+static uint64_t nr_rec, first;
+
+static void load_trace(const char *file) {
+	int fd = open(file, O_RDONLY);
+	if(fd < 0) { perror(file); exit(1); }
+	struct stat st;
+	fstat(fd, &st);
+
+	header = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if(header == MAP_FAILED || st.st_size < sizeof(*header) ||
+			memcmp(header->magic, ITRACE_MAGIC, sizeof(header->magic)) != 0 ||
+			header->record_size != sizeof(ITraceRecord) ||
+			st.st_size < sizeof(*header) + (uint64_t)header->nr_record * sizeof(ITraceRecord)) {
+		fprintf(stderr, "%s: not an instruction trace of NEMU\n", file);
+		exit(1);
+	}
+	close(fd);
+
+	ring = (void *)(header + 1);
+	if(header->count > header->nr_record) {
+		nr_rec = header->nr_record;
+		first = header->count % header->nr_record;
+	}
+	else {
+		nr_rec = header->count;
+		first = 0;
+	}
+}
+
+static ITraceRecord *record(uint64_t i) {
+	return &ring[(first + i) % header->nr_record];
+}
+
+/* Functions */
+
+typedef struct {
+	uint32_t start, end;
+	const char *name;
+} Func;
+
+static Func *funcs;
+static int nr_func;
+
+static int cmp_func_addr(const void *a, const void *b) {
+	const Func *x = a, *y = b;
+	return (x->start > y->start) - (x->start < y->start);
+}
+
+static void load_symbols(const char *file) {
+	int fd = open(file, O_RDONLY);
+	if(fd < 0) { perror(file); exit(1); }
+	struct stat st;
+	fstat(fd, &st);
+	uint8_t *buf = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	assert(buf != MAP_FAILED);
+	close(fd);
+
+	Elf32_Ehdr *elf = (void *)buf;
+	if(memcmp(elf->e_ident, ELFMAG, SELFMAG) != 0 || elf->e_ident[EI_CLASS] != ELFCLASS32) {
+		fprintf(stderr, "%s: not an ELF32 file\n", file);
+		exit(1);
+	}
+
+	Elf32_Shdr *sh = (void *)(buf + elf->e_shoff);
+	int i;
+	for(i = 0; i < elf->e_shnum; i ++) {
+		if(sh[i].sh_type != SHT_SYMTAB) { continue; }
+		Elf32_Sym *sym = (void *)(buf + sh[i].sh_offset);
+		const char *str = (void *)(buf + sh[sh[i].sh_link].sh_offset);
+		int n = sh[i].sh_size / sizeof(Elf32_Sym), j;
+		funcs = calloc(n, sizeof(Func));
+		assert(funcs);
+		for(j = 0; j < n; j ++) {
+			if(ELF32_ST_TYPE(sym[j].st_info) == STT_FUNC) {
+				funcs[nr_func ++] = (Func) { sym[j].st_value, sym[j].st_value + sym[j].st_size, str + sym[j].st_name };
+			}
+		}
+	}
+	qsort(funcs, nr_func, sizeof(Func), cmp_func_addr);
+}
+
+static Func *find_func(uint32_t eip) {
+	int l = 0, r = nr_func - 1;
+	while(l <= r) {
+		int m = (l + r) / 2;
+		if(eip < funcs[m].start) { r = m - 1; }
+		else if(eip >= funcs[m].end) { l = m + 1; }
+		else { return &funcs[m]; }
+	}
+	return NULL;
+}
+
+static Func *find_func_by_name(const char *name) {
+	int i;
+	for(i = 0; i < nr_func; i ++) {
+		if(strcmp(funcs[i].name, name) == 0) { return &funcs[i]; }
+	}
+	return NULL;
+}
+
+/* Disassembly, the text of each address is taken from `objdump -d'. */
+
+typedef struct {
+	uint32_t addr;
+	char *text;
+} Disasm;
+
+static Disasm *disasm;
+static size_t nr_disasm;
+
+static int cmp_disasm(const void *a, const void *b) {
+	const Disasm *x = a, *y = b;
+	return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+static void load_disasm(const char *file) {
+	int fd[2];
+	if(pipe(fd) != 0) { perror("pipe"); exit(1); }
+	pid_t pid = fork();
+	if(pid == 0) {
+		dup2(fd[1], STDOUT_FILENO);
+		close(fd[0]);
+		close(fd[1]);
+		execlp("objdump", "objdump", "-d", "--no-show-raw-insn", file, NULL);
+		_exit(127);
+	}
+	close(fd[1]);
+
+	FILE *fp = fdopen(fd[0], "r");
+	size_t cap = 0;
+	char line[512];
+	while(fgets(line, sizeof(line), fp)) {
+		char *tab = strchr(line, '\t');
+		char *end;
+		uint32_t addr = strtoul(line, &end, 16);
+		if(tab == NULL || end == line || *end != ':') { continue; }
+
+		tab[strcspn(tab, "\n")] = '\0';
+		if(nr_disasm == cap) {
+			cap = (cap ? cap * 2 : 4096);
+			disasm = realloc(disasm, cap * sizeof(Disasm));
+			assert(disasm);
+		}
+		disasm[nr_disasm ++] = (Disasm) { addr, strdup(tab + 1) };
+	}
+	fclose(fp);
+	waitpid(pid, NULL, 0);
+	qsort(disasm, nr_disasm, sizeof(Disasm), cmp_disasm);
+}
+
+static Disasm *find_disasm(uint32_t addr) {
+	size_t l = 0, r = nr_disasm;
+	while(l < r) {
+		size_t m = (l + r) / 2;
+		if(disasm[m].addr < addr) { l = m + 1; }
+		else { r = m; }
+	}
+	return (l < nr_disasm && disasm[l].addr == addr ? &disasm[l] : NULL);
+}
+
+/* Printing */
+
+static void print_record(uint64_t i) {
+	ITraceRecord *r = record(i);
+	ITraceRecord *prev = (i > 0 ? record(i - 1) : NULL);
+
+	/* An instruction which sets eip does not know its length, which is
+	 * then taken from the disassembly.
+	 */
+	Disasm *d = find_disasm(r->eip);
+	int len = r->len;
+	if(len == 0 && d != NULL && d + 1 < disasm + nr_disasm) { len = d[1].addr - d->addr; }
+	if(len > ITRACE_INSTR_LEN) { len = ITRACE_INSTR_LEN; }
+
+	char bytes[3 * ITRACE_INSTR_LEN + 3] = "";
+	int j;
+	for(j = 0; j < len; j ++) {
+		sprintf(bytes + 3 * j, "%02x ", r->instr[j]);
+	}
+	if(len == 0) {
+		sprintf(bytes, "%02x ..", r->instr[0]);
+	}
+
+	printf("%10" PRIu64 "  %08x:  %-24s", header->count - nr_rec + i, r->eip, bytes);
+	Func *f = find_func(r->eip);
+	if(f) {
+		printf(" <%s+%u>", f->name, r->eip - f->start);
+	}
+	if(d) {
+		printf(" %s", d->text);
+	}
+
+	if(prev) {
+		for(j = 0; j < 8; j ++) {
+			if(r->gpr[j] != prev->gpr[j]) { printf("  %s=0x%x", regs[j], r->gpr[j]); }
+		}
+		if(r->eflags != prev->eflags) { printf("  eflags=0x%x", r->eflags); }
+	}
+	for(j = 0; j < r->nr_mem && j < ITRACE_NR_MEM; j ++) {
+		printf("  [0x%08x]%d=0x%x", r->mem_addr[j], r->mem_len[j], r->mem_data[j]);
+	}
+	if(r->nr_mem > ITRACE_NR_MEM) {
+		printf("  (+%d writes)", r->nr_mem - ITRACE_NR_MEM);
+	}
+	printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+	uint32_t start = 0, end = 0xffffffff;
+	const char *func = NULL;
+	uint64_t last = 0;
+	int o;
+	while((o = getopt(argc, argv, "r:f:n:")) != -1) {
+		switch(o) {
+			case 'r': {
+				char *p;
+				start = strtoul(optarg, &p, 16);
+				end = (*p == ',' ? strtoul(p + 1, NULL, 16) : start + 1);
+				break;
+			}
+			case 'f': func = optarg; break;
+			case 'n': last = strtoull(optarg, NULL, 0); break;
+			default: goto usage;
+		}
+	}
+	if(optind != argc - 1 && optind != argc - 2) { goto usage; }
+
+	load_trace(argv[optind]);
+	if(optind == argc - 2) {
+		load_symbols(argv[optind + 1]);
+		load_disasm(argv[optind + 1]);
+	}
+	if(func) {
+		Func *f = find_func_by_name(func);
+		if(f == NULL) {
+			fprintf(stderr, "function '%s' is not found\n", func);
+			return 1;
+		}
+		start = f->start;
+		end = f->end;
+	}
+
+	printf("%" PRIu64 " instructions traced, the last %" PRIu64 " are kept\n", header->count, nr_rec);
+
+	uint64_t i, nr_selected = 0;
+	for(i = 0; i < nr_rec; i ++) {
+		uint32_t eip = record(i)->eip;
+		if(eip >= start && eip < end) { nr_selected ++; }
+	}
+
+	uint64_t skip = (last > 0 && nr_selected > last ? nr_selected - last : 0);
+	for(i = 0; i < nr_rec; i ++) {
+		uint32_t eip = record(i)->eip;
+		if(eip < start || eip >= end) { continue; }
+		if(skip > 0) { skip --; continue; }
+		print_record(i);
+	}
+	return 0;
+
+usage:
+	fprintf(stderr, "usage: %s [-r START[,END]] [-f FUNC] [-n N] TRACE [ELF]\n"
+			"  -r  only the instructions with eip in [START, END), in hex\n"
+			"  -f  only the instructions in function FUNC of the ELF file\n"
+			"  -n  only the last N instructions selected\n", argv[0]);
+	return 1;
+}
@@ -1,17 +1,17 @@
 #!/bin/bash
 
 nemu=obj/nemu/nemu
-cmd="c\nq"
 
 for file in $@; do
 	printf "[$file]"
 	logfile=`basename $file`-log.txt
-	echo -e $cmd | /usr/bin/time -f '%e' -o time.log $nemu $file &> $logfile
-	time_cost=`cat time.log`
+	/usr/bin/time -f '%e' -o time.log $nemu -b --exit-code --log log.txt $file &> $logfile
+	status=$?
+	time_cost=`tail -n 1 time.log`
 	printf "($time_cost s): "
 	rm time.log
 
-	if (grep 'nemu: HIT GOOD TRAP' $logfile > /dev/null) then
+	if [ $status -eq 0 ]; then
 		echo -e "\033[1;32mPASS!\033[0m"
 		rm $logfile
 	else